@@ -0,0 +1,97 @@
+/*
+ * Axis Predictor
+ *
+ * Short-horizon extrapolation of analog axes while reports are missing. The
+ * velocity of each axis is estimated from consecutive values and their sender
+ * (evdev) timestamps, so network jitter doesn't distort it. The report interval
+ * of each device is learned from the timestamps too; once a device's data is
+ * late by more than late_factor intervals, predict() extrapolates its moving
+ * axes along their velocity for at most max_intervals intervals, then holds.
+ *
+ * evdev reports only changes, so an axis missing from a report held still: its
+ * velocity drops to zero and it is no longer extrapolated. Reports are told
+ * apart by timestamp (events of one report share it; no EV_SYN on the wire).
+ * State is allocated on a device's first event; prediction only visits axes
+ * with a non-zero velocity.
+ *
+ * Only axes whose normalized value is meaningful (ENTRY_NORMALIZED) stop at the
+ * end of the normalized range; raw pass-through axes extrapolate their raw value
+ * unclamped, since their range is unknown here.
+ */
+
+#ifndef AXIS_PREDICTOR_HPP
+#define AXIS_PREDICTOR_HPP
+
+#include "xbox_udp_protocol.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+
+class AxisPredictor {
+public:
+    static constexpr unsigned AXIS_COUNT = xbox_udp::FILTER_ABS_COUNT;  // ABS_CNT, one mask bit each
+
+    struct Config {
+        // Axes to extrapolate (bit = EV_ABS code): all but the hats (ABS_HAT0X..ABS_HAT3Y),
+        // which are discrete
+        uint64_t axes = ~0x0000000000ff0000ull;
+        double velocity_alpha = 0.5;   // Weight of the newest velocity sample
+        double late_factor = 1.5;      // Data is missing after this many report intervals
+        double max_intervals = 2.0;    // Extrapolate over at most this many intervals
+        uint32_t max_gap_us = 50000;   // Longer pauses between reports are idleness, not motion
+    };
+
+    AxisPredictor() : AxisPredictor(Config()) {}
+    explicit AxisPredictor(const Config& config);
+
+    // An event of a report received at now_ns (steady clock). `normalized`: the
+    // event's normalized value is one (ENTRY_NORMALIZED), not a copy of the raw value.
+    void observe(const xbox_udp::InputEventPacket& pkt, uint64_t now_ns, bool normalized);
+    // Legacy event packets carry no flag: values within [-1.0, 1.0] count as
+    // normalized, the rule frame encoders use for ENTRY_NORMALIZED
+    void observe(const xbox_udp::InputEventPacket& pkt, uint64_t now_ns) {
+        observe(pkt, now_ns, pkt.normalized >= -1.0 && pkt.normalized <= 1.0);
+    }
+    // A value from a keyframe: not part of a report, so the axis stops moving
+    void reset(const xbox_udp::InputEventPacket& pkt, bool normalized);
+
+    // Extrapolate the device's moving axes to now_ns if its data is late. Writes
+    // values[code] and normalized[code] (arrays of AXIS_COUNT) for each predicted
+    // axis; returns the mask of those axes, 0 if the data isn't late.
+    uint64_t predict(uint8_t device_id, uint64_t now_ns, int32_t* values, double* normalized) const;
+
+    // Learned report interval of a device in microseconds (0 until two reports arrived)
+    uint32_t intervalUs(uint8_t device_id) const;
+    const Config& getConfig() const { return config_; }
+
+    // steady_clock in nanoseconds, the clock observe() and predict() expect
+    static uint64_t nowNs();
+
+private:
+    struct Track {
+        uint64_t timestamp_ns = 0;   // Sender timestamp of the last value
+        int32_t value = 0;
+        double normalized = 0.0;
+        double velocity = 0.0;       // Raw units per ns
+        double velocity_norm = 0.0;  // Normalized units per ns
+        bool is_normalized = false;  // `normalized` is ENTRY_NORMALIZED, not the raw value
+    };
+
+    struct Device {
+        uint64_t report_ns = 0;    // Sender timestamp of the newest report
+        uint64_t arrival_ns = 0;   // Local time the newest packet arrived
+        double interval_ns = 0.0;  // Smoothed interval between reports
+        uint64_t moving = 0;       // Axes with a non-zero velocity
+        uint64_t updated = 0;      // Axes carried by the newest report
+        std::array<Track, AXIS_COUNT> axes{};
+    };
+
+    Config config_;
+    uint64_t max_gap_ns_;
+    std::array<std::unique_ptr<Device>, 256> devices_;
+
+    Device& device(uint8_t device_id);
+    void startReport(Device& dev, uint64_t timestamp_ns);
+};
+
+#endif // AXIS_PREDICTOR_HPP
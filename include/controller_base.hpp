@@ -14,6 +14,7 @@
 #include <linux/input.h>
 #include <memory>
 #include <string>
+#include <vector>
 
 struct ControllerHandle {
     int fd = -1;
@@ -38,9 +39,17 @@ public:
     virtual bool sendVibration(uint16_t left_motor, uint16_t right_motor) = 0;
     virtual void stopVibration() = 0;
     
+    // Latest full state (keyframe), seeded from the device and kept current by processEvent
+    const xbox_udp::StatePacket& getState() const { return state_; }
+
+    // After SYN_DROPPED: query the kernel for the current key and axis values
+    // (EVIOCGKEY/EVIOCGABS, not libevdev's cache, which is stale when its reads
+    // are bypassed) and append an event for each one that differs from getState()
+    void resyncEvents(std::vector<struct input_event>& out) const;
+    
     // Getters
     uint8_t getDeviceId() const { return device_id_; }
-    void setDeviceId(uint8_t id) { device_id_ = id; }
+    void setDeviceId(uint8_t id) { device_id_ = id; state_.device_id = id; }
     const std::string& getName() const { return handle_.name; }
     const std::string& getPath() const { return handle_.path; }
     int getFd() const { return handle_.fd; }
@@ -50,9 +59,16 @@ public:
 protected:
     ControllerHandle handle_;
     uint8_t device_id_;
+    xbox_udp::StatePacket state_;
     
     // Helper: normalize axis value using config
     double normalizeAxisValue(unsigned code, int32_t raw_value) const;
+    
+    // Helper: apply a processed event to state_
+    void updateState(const xbox_udp::InputEventPacket& pkt);
+
+private:
+    void initState();
 };
 
 // Xbox Controller implementation
@@ -0,0 +1,110 @@
+/*
+ * Controller State Table
+ *
+ * Current state of every controller seen on the wire, built by applying input
+ * event streams (events, frames, state keyframes). Each device has a dense
+ * state: a button bitset over all EV_KEY codes, fixed arrays of raw and
+ * normalized EV_ABS values, and the dpad buttons of the controller config
+ * derived from the hat axes. Updates and queries are O(1); a device's state is
+ * allocated on its first event, nothing is allocated after that.
+ *
+ * With setPrediction(), predict() fills in extrapolated values for the moving
+ * axes of devices whose reports are late (see AxisPredictor), flagged in
+ * DeviceState::predicted until the axis reports again.
+ */
+
+#ifndef CONTROLLER_STATE_TABLE_HPP
+#define CONTROLLER_STATE_TABLE_HPP
+
+#include "axis_predictor.hpp"
+#include "xbox_udp_protocol.hpp"
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ControllerConfig;
+
+class ControllerStateTable {
+public:
+    static constexpr size_t MAX_DEVICES = 256;
+    static constexpr unsigned KEY_COUNT = xbox_udp::FILTER_KEY_COUNT;  // KEY_CNT
+    static constexpr unsigned AXIS_COUNT = xbox_udp::FILTER_ABS_COUNT; // ABS_CNT
+    // Dpad buttons beyond this many config entries are ignored
+    static constexpr size_t MAX_DPAD_BUTTONS = 16;
+
+    struct DeviceState {
+        std::bitset<KEY_COUNT> buttons;        // Pressed keys
+        std::bitset<KEY_COUNT> reported_keys;  // Keys that sent at least one event
+        std::bitset<AXIS_COUNT> reported_axes; // Axes that sent at least one event
+        std::array<int32_t, AXIS_COUNT> axes{};       // Raw axis values
+        std::array<double, AXIS_COUNT> normalized{};  // Normalized axis values
+        // Dpad buttons, indexed like ControllerConfig::getDpadButtonMappings()
+        std::bitset<MAX_DPAD_BUTTONS> dpad;
+        std::bitset<AXIS_COUNT> predicted;     // Axes holding values extrapolated by predict()
+        uint64_t events = 0;                   // Events applied
+    };
+
+    // Without a config no dpad buttons are derived
+    explicit ControllerStateTable(std::shared_ptr<const ControllerConfig> config = nullptr);
+
+    void setConfig(std::shared_ptr<const ControllerConfig> config);
+    const std::shared_ptr<const ControllerConfig>& getConfig() const { return config_; }
+
+    void apply(const xbox_udp::InputEventPacket& pkt);
+    void apply(const xbox_udp::FramePacket& frame);
+    void apply(const xbox_udp::StatePacket& state);
+
+    // Extrapolate moving axes while reports are missing (off by default)
+    void setPrediction(const AxisPredictor::Config& config);
+    const AxisPredictor* getPredictor() const { return predictor_.get(); }
+    // Write predicted values for the late devices' moving axes; call at the rate
+    // the values are consumed. Returns the number of axes whose value changed.
+    size_t predict(uint64_t now_ns = AxisPredictor::nowNs());
+
+    // Devices that sent at least one event, in order of their first event
+    const std::vector<uint8_t>& devices() const { return active_; }
+    // nullptr until the device sent an event
+    const DeviceState* device(uint8_t device_id) const { return devices_[device_id].get(); }
+
+    bool button(uint8_t device_id, unsigned code) const {
+        const DeviceState* state = device(device_id);
+        return state && code < KEY_COUNT && state->buttons[code];
+    }
+    int32_t axis(uint8_t device_id, unsigned code) const {
+        const DeviceState* state = device(device_id);
+        return state && code < AXIS_COUNT ? state->axes[code] : 0;
+    }
+    double normalized(uint8_t device_id, unsigned code) const {
+        const DeviceState* state = device(device_id);
+        return state && code < AXIS_COUNT ? state->normalized[code] : 0.0;
+    }
+    bool dpadButton(uint8_t device_id, size_t index) const {
+        const DeviceState* state = device(device_id);
+        return state && index < MAX_DPAD_BUTTONS && state->dpad[index];
+    }
+
+private:
+    struct DpadEntry {
+        int32_t value;  // Axis value that presses this button
+        uint8_t index;  // Bit in DeviceState::dpad
+    };
+
+    std::shared_ptr<const ControllerConfig> config_;
+    std::array<std::unique_ptr<DeviceState>, MAX_DEVICES> devices_;
+    std::vector<uint8_t> active_;
+    std::unique_ptr<AxisPredictor> predictor_;
+
+    // Dpad buttons grouped by axis: entries [dpad_begin_[code], dpad_begin_[code + 1])
+    std::array<uint8_t, AXIS_COUNT + 1> dpad_begin_{};
+    std::vector<DpadEntry> dpad_entries_;
+    // Per axis: bits in DeviceState::dpad driven by that axis
+    std::array<std::bitset<MAX_DPAD_BUTTONS>, AXIS_COUNT> dpad_axis_bits_;
+
+    DeviceState& deviceState(uint8_t device_id);
+    void applyEvent(const xbox_udp::InputEventPacket& pkt);
+    void applyDpad(DeviceState& state, unsigned code, int32_t value) const;
+};
+
+#endif // CONTROLLER_STATE_TABLE_HPP
@@ -0,0 +1,149 @@
+/*
+ * io_uring Event Loop Support
+ *
+ * IoRing is a minimal io_uring wrapper on the raw syscalls (no liburing):
+ * queue SQEs, then submit them and wait for completions in one
+ * io_uring_enter(). IoRingSender plugs into UDPPublisher::setSender() and turns
+ * each flush() into SENDMSG SQEs that go out with the event loop's next
+ * io_uring_enter(), so a report costs no syscall of its own.
+ *
+ * Only built when <linux/io_uring.h> is available (XBOX_HAVE_IO_URING); the
+ * poll() loops remain the fallback when io_uring_setup() is refused at run time.
+ */
+
+#ifndef IO_RING_HPP
+#define IO_RING_HPP
+
+#include "xbox_udp_protocol.hpp"
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class IoRing {
+public:
+    struct Stats {
+        uint64_t enters = 0;       // io_uring_enter() calls
+        uint64_t submitted = 0;    // SQEs consumed by the kernel
+        uint64_t completions = 0;  // CQEs reaped
+    };
+
+    // user_data bit of the POLL_ADD half of pollRead() (its CQE is only posted on failure)
+    static constexpr uint64_t POLL_LINK = 1ull << 62;
+
+    explicit IoRing(unsigned entries = 256);
+    ~IoRing();
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    // A zeroed SQE to fill in, or nullptr if the submission queue is full even
+    // after submitting what is queued
+    struct io_uring_sqe* getSqe();
+    // SQEs queued and not yet submitted
+    unsigned pending() const { return sqe_tail_ - sqe_head_; }
+    // Make room for n SQEs, submitting the queued ones if needed, so that a
+    // linked chain isn't split across two submissions
+    bool reserve(unsigned n);
+
+    // Submit the queued SQEs, then wait until at least wait_nr completions are
+    // available or timeout_ms passes (-1 = no timeout). False on errors other
+    // than timeout and EINTR.
+    bool submit(unsigned wait_nr = 0, int timeout_ms = -1);
+
+    // Pass every available CQE to f(const io_uring_cqe&); returns the number reaped
+    template <typename F>
+    size_t forEachCompletion(F&& f) {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        size_t n = 0;
+        for (; head != tail; ++head, ++n) {
+            f(static_cast<const struct io_uring_cqe&>(cqes_[head & cq_mask_]));
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        stats_.completions += n;
+        return n;
+    }
+
+    // Read up to len bytes from the O_NONBLOCK fd once it is readable: POLL_ADD
+    // linked to a READ, so the read neither fails with EAGAIN nor needs a syscall
+    // of its own. The READ completes with user_data (-ECANCELED if the poll
+    // failed, whose CQE then carries user_data | POLL_LINK).
+    bool pollRead(int fd, void* buf, size_t len, uint64_t user_data);
+    // Multishot POLL_ADD: a CQE with user_data (flag IORING_CQE_F_MORE while it
+    // stays armed) every time fd becomes readable
+    bool pollMultishot(int fd, uint64_t user_data);
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    int fd_ = -1;
+    unsigned features_ = 0;
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_head_ = 0;  // Next SQE the kernel hasn't consumed
+    unsigned sqe_tail_ = 0;  // Next SQE to hand out
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+    Stats stats_;
+
+    void unmap();
+    // Whether multishot POLL_ADD (IORING_POLL_ADD_MULTI, 5.13) works
+    bool probeMultishotPoll();
+};
+
+// UDPPublisher::Sender on an IoRing: copies each message into a slot of its own
+// (the publisher reuses its buffers at once) and queues one SENDMSG per
+// message, hard-linked so a batch goes out in order even if one send fails.
+// Sends are MSG_DONTWAIT: a full socket buffer drops the packet, as sendmmsg()
+// on a UDP socket would, and never leaves a send pending on the ring.
+class IoRingSender {
+public:
+    // user_data bit of send completions; route them to complete()
+    static constexpr uint64_t TAG = 1ull << 63;
+
+    struct Stats {
+        uint64_t datagrams = 0;  // Sends completed with the full length
+        uint64_t errors = 0;     // Failed or short sends
+        uint64_t no_slot = 0;    // Messages refused: every slot awaited its completion
+    };
+
+    explicit IoRingSender(IoRing& ring, size_t slots = 256);
+
+    // The UDPPublisher::Sender signature: how many of the messages were queued
+    int send(int sock, struct mmsghdr* msgs, unsigned count, int flags);
+    // Account for a send completion and free its slot; false if the CQE isn't one
+    bool complete(const struct io_uring_cqe& cqe);
+    // Sends queued whose completion hasn't been reaped: add them to the next
+    // submit()'s wait_nr so that their CQEs don't end the wait on their own
+    unsigned inFlight() const { return static_cast<unsigned>(slots_.size() - free_.size()); }
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    struct Slot {
+        struct msghdr hdr;
+        struct iovec iov;
+        struct sockaddr_storage addr;
+        xbox_udp::EventBuffer data;
+    };
+
+    IoRing& ring_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_;
+    Stats stats_;
+};
+
+#endif // IO_RING_HPP
@@ -0,0 +1,180 @@
+/*
+ * Jitter Buffer
+ *
+ * Smooths clumped arrivals (e.g. over Wi-Fi) by holding packets and releasing
+ * them at their sender timestamp plus a playout delay, mapped onto the local
+ * clock. The mapping uses the smallest (arrival - timestamp) seen in a sliding
+ * window, so it follows clock offset and drift without synchronized clocks.
+ * The delay is fixed, or adapts to the largest jitter in the window within
+ * [delay_us, max_delay_us].
+ *
+ * Packets of a device are released in timestamp order. A packet that arrives
+ * after its playout time is released immediately (late); one older than a
+ * packet already released is dropped (late drop). Storage is preallocated.
+ *
+ * State packets are keyframes: their timestamp is the device's last change, not
+ * a send time, so they stay out of the offset and jitter estimates. A state is
+ * held until the device's packets queued before it have played out, then
+ * released right behind them; it never releases the queue early.
+ */
+
+#ifndef JITTER_BUFFER_HPP
+#define JITTER_BUFFER_HPP
+
+#include "xbox_udp_protocol.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class JitterBuffer {
+public:
+    struct Config {
+        uint32_t delay_us = 10000;      // Playout delay (minimum delay when adaptive)
+        bool adaptive = false;          // Grow the delay up to max_delay_us to cover the jitter seen
+        uint32_t max_delay_us = 50000;  // Upper bound of the adaptive delay
+        uint32_t window_ms = 2000;      // Window of the clock offset and jitter estimates
+        size_t capacity = 256;          // Buffered packets; when full the earliest is released early
+    };
+
+    struct Stats {
+        uint64_t packets = 0;        // Packets pushed
+        uint64_t released = 0;       // Packets released (on time, late or early)
+        uint64_t late = 0;           // Arrived after their playout time, released immediately
+        uint64_t late_dropped = 0;   // Older than a packet already released; dropped
+        uint64_t overflow = 0;       // Released before their playout time because the buffer was full
+        uint64_t added_latency_ns = 0;      // Sum of (release - arrival) over released packets
+        uint64_t max_added_latency_ns = 0;
+        uint32_t delay_us = 0;       // Current playout delay
+        uint32_t jitter_us = 0;      // Largest jitter in the window
+
+        double meanAddedLatencyUs() const {
+            return released ? static_cast<double>(added_latency_ns) / released / 1000.0 : 0.0;
+        }
+    };
+
+    JitterBuffer() : JitterBuffer(Config()) {}
+    explicit JitterBuffer(const Config& config);
+
+    // Buffer a packet that arrived at now_ns (steady clock); packets are copied.
+    // When the buffer is full, the earliest packet is first released to `sink`.
+    template <typename Sink>
+    void push(const xbox_udp::InputEventPacket& pkt, uint64_t now_ns, Sink& sink) {
+        makeRoom(now_ns, sink);
+        insert(Kind::Event, pkt.device_id, xbox_udp::toTimestampNs(pkt.sec, pkt.usec), &pkt, sizeof(pkt), now_ns);
+    }
+    template <typename Sink>
+    void push(const xbox_udp::FramePacket& frame, uint64_t now_ns, Sink& sink) {
+        makeRoom(now_ns, sink);
+        insert(Kind::Frame, frame.header.device_id, frame.header.timestamp_ns, &frame,
+               xbox_udp::frameSize(frame.header.count, frame.header.history), now_ns);
+    }
+    // Released after the device's packets already queued (at once if there are none)
+    template <typename Sink>
+    void push(const xbox_udp::StatePacket& state, uint64_t now_ns, Sink& sink) {
+        makeRoom(now_ns, sink);
+        insertState(state, now_ns);
+    }
+
+    // Pass every packet due at now_ns to sink.onEvent()/onFrame()/onState(), in
+    // playout order; returns the number released
+    template <typename Sink>
+    size_t release(uint64_t now_ns, Sink& sink) {
+        size_t released = 0;
+        while (!heap_.empty() && heap_.front().playout_ns <= now_ns) {
+            releaseFront(now_ns, sink);
+            ++released;
+        }
+        return released;
+    }
+
+    // Playout time of the next packet, or 0 if the buffer is empty
+    uint64_t nextPlayoutNs() const { return heap_.empty() ? 0 : heap_.front().playout_ns; }
+    size_t size() const { return heap_.size(); }
+    const Config& getConfig() const { return config_; }
+    Stats getStats() const;
+
+    // steady_clock in nanoseconds, the clock push() and release() expect
+    static uint64_t nowNs();
+
+private:
+    enum class Kind : uint8_t { Event, Frame, State };
+
+    struct Slot {
+        Kind kind;
+        uint64_t arrival_ns;
+        xbox_udp::EventBuffer buf;
+    };
+
+    struct HeapEntry {
+        uint64_t playout_ns;
+        uint64_t order;  // Push order, breaks ties
+        uint32_t slot;
+    };
+
+    // Extreme (min or max) over a sliding window, kept as two half-window buckets
+    struct WindowedExtreme {
+        bool started = false;
+        int64_t current = 0;
+        int64_t previous = 0;
+        uint64_t bucket_start_ns = 0;
+    };
+
+    struct Device {
+        WindowedExtreme offset;  // Min of (arrival - timestamp)
+        WindowedExtreme jitter;  // Max of (arrival - timestamp - offset)
+        uint64_t last_playout_ns = 0;   // Of the newest packet pushed
+        uint64_t last_pushed_ts = 0;
+        uint64_t last_released_ts = 0;
+        bool released_any = false;
+    };
+
+    Config config_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_slots_;
+    std::vector<HeapEntry> heap_;  // Min-heap on playout time
+    std::array<Device, 256> devices_;
+    uint64_t order_ = 0;
+    Stats stats_;
+
+    static bool later(const HeapEntry& a, const HeapEntry& b) {
+        return a.playout_ns != b.playout_ns ? a.playout_ns > b.playout_ns : a.order > b.order;
+    }
+    static uint8_t deviceOf(const Slot& slot);
+    static uint64_t timestampOf(const Slot& slot);
+
+    void updateWindow(WindowedExtreme& w, int64_t value, uint64_t now_ns, bool is_min) const;
+    static int64_t windowValue(const WindowedExtreme& w, bool is_min);
+    void insert(Kind kind, uint8_t device_id, uint64_t timestamp_ns, const void* data, size_t len,
+                uint64_t now_ns);
+    // Take the earliest packet off the heap and account for its release
+    uint32_t popFront(uint64_t now_ns);
+    void insertState(const xbox_udp::StatePacket& state, uint64_t now_ns);
+    void enqueue(Kind kind, const void* data, size_t len, uint64_t playout_ns, uint64_t now_ns);
+
+    template <typename Sink>
+    void releaseFront(uint64_t now_ns, Sink& sink) {
+        const uint32_t index = popFront(now_ns);
+        const Slot& slot = slots_[index];
+        switch (slot.kind) {
+        case Kind::Event:
+            sink.onEvent(*reinterpret_cast<const xbox_udp::InputEventPacket*>(slot.buf.data));
+            break;
+        case Kind::Frame:
+            sink.onFrame(*reinterpret_cast<const xbox_udp::FramePacket*>(slot.buf.data));
+            break;
+        case Kind::State:
+            sink.onState(*reinterpret_cast<const xbox_udp::StatePacket*>(slot.buf.data));
+            break;
+        }
+        free_slots_.push_back(index);
+    }
+
+    template <typename Sink>
+    void makeRoom(uint64_t now_ns, Sink& sink) {
+        if (!free_slots_.empty()) return;
+        ++stats_.overflow;
+        releaseFront(now_ns, sink);
+    }
+};
+
+#endif // JITTER_BUFFER_HPP
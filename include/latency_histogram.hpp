@@ -0,0 +1,54 @@
+/*
+ * Latency Histogram
+ *
+ * HDR-style histogram of nanosecond latencies: values below 2^SUB_BITS are
+ * counted exactly, larger ones in SUB_COUNT linear buckets per power of two, so
+ * every recorded value is kept within 1/SUB_COUNT (~3%) relative error from 1 ns
+ * up to MAX_VALUE (larger values are clamped). Recording is O(1) and does not
+ * allocate; percentiles walk the fixed bucket array.
+ */
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr unsigned SUB_COUNT = 1u << SUB_BITS;
+    static constexpr unsigned MAX_EXPONENT = 40;  // Values up to 2^40 ns (~18 min)
+    static constexpr uint64_t MAX_VALUE = (1ull << MAX_EXPONENT) - 1;
+
+    // Negative latencies (sender clock ahead of ours) are only counted
+    void record(int64_t value_ns);
+
+    uint64_t count() const { return count_; }
+    uint64_t negative() const { return negative_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+    // Smallest recorded value that p percent (0-100) of the values are at or below,
+    // as the upper end of its bucket; 0 if empty
+    uint64_t percentile(double p) const;
+
+    void merge(const LatencyHistogram& other);
+    void reset();
+
+private:
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) * SUB_COUNT;
+
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0;
+    uint64_t negative_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    uint64_t sum_ = 0;
+
+    static size_t bucketOf(uint64_t value);
+    static uint64_t bucketUpper(size_t bucket);
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
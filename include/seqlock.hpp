@@ -0,0 +1,78 @@
+/*
+ * Seqlock
+ *
+ * Single-writer, multi-reader publication of a trivially copyable value. The
+ * writer never waits; readers copy the value and retry if a write overlapped
+ * the copy, so they always get a consistent (tear-free) value without taking a
+ * lock. The value is stored as relaxed atomic words, so concurrent copies are
+ * well-defined.
+ */
+
+#ifndef SEQLOCK_HPP
+#define SEQLOCK_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock value must be trivially copyable");
+
+public:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    Seqlock() {
+        for (auto& word : data_) word.store(0, std::memory_order_relaxed);
+    }
+
+    // Publish a new value. Only one thread may write.
+    void store(const T& value) {
+        uint64_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        const uint64_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);  // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) {
+            data_[i].store(words[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // One read attempt; false if a write was in progress or overlapped the copy
+    bool tryLoad(T& out) const {
+        const uint64_t before = seq_.load(std::memory_order_acquire);
+        if (before & 1) return false;
+        uint64_t words[WORDS];
+        for (size_t i = 0; i < WORDS; ++i) {
+            words[i] = data_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) != before) return false;
+        std::memcpy(&out, words, sizeof(T));
+        return true;
+    }
+
+    // Retry until a consistent copy is read; returns the number of retries
+    unsigned load(T& out) const {
+        unsigned retries = 0;
+        while (!tryLoad(out)) {
+            // A preempted writer can't finish while we spin on its CPU
+            if (++retries % 4 == 0) std::this_thread::yield();
+        }
+        return retries;
+    }
+
+    // Number of completed stores
+    uint64_t version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+private:
+    alignas(64) std::atomic<uint64_t> seq_{0};
+    std::atomic<uint64_t> data_[WORDS];
+};
+
+#endif // SEQLOCK_HPP
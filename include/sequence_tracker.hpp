@@ -0,0 +1,65 @@
+/*
+ * Sequence Tracker
+ *
+ * Per-device accounting of the sequence numbers carried by frame and state
+ * packets: loss (gaps), duplicates and reordering.
+ */
+
+#ifndef SEQUENCE_TRACKER_HPP
+#define SEQUENCE_TRACKER_HPP
+
+#include <cstdint>
+
+struct SequenceStats {
+    uint64_t received = 0;    // Packets seen (including duplicates)
+    uint64_t lost = 0;        // Sequence numbers skipped and not (yet) received
+    uint64_t duplicates = 0;  // Sequence numbers received more than once
+    uint64_t reordered = 0;   // Packets that arrived after a newer one
+    uint64_t stale = 0;       // Packets too old to classify (outside the window)
+    uint64_t resets = 0;      // Sender restarts detected (large backwards jump)
+    uint64_t recovered = 0;   // Button edges restored from redundant frame history
+
+    SequenceStats& operator+=(const SequenceStats& other);
+};
+
+class SequenceTracker {
+public:
+    enum class Result {
+        First,      // First packet from this device
+        InOrder,    // Next expected sequence number
+        Gap,        // Newer than expected; one or more packets missing
+        Duplicate,  // Already received
+        Reordered,  // Older than the newest, not seen before (fills a gap)
+        Stale,      // Older than the tracking window
+        Reset       // Sender restarted; tracking starts over
+    };
+
+    // Number of sequence numbers below the newest that are tracked for duplicates/reordering
+    static constexpr uint32_t WINDOW = 64;
+    // A backwards jump larger than this is treated as a sender restart
+    static constexpr uint32_t RESET_THRESHOLD = 4096;
+
+    Result update(uint32_t seq);
+
+    void addRecovered(uint64_t count) { stats_.recovered += count; }
+
+    // True if `seq` is in the window and was received
+    bool wasReceived(uint32_t seq) const;
+    bool isStarted() const { return started_; }
+    uint32_t highest() const { return highest_; }
+    const SequenceStats& getStats() const { return stats_; }
+
+    // Whether the packet should be passed on when stale/out-of-order packets are dropped
+    static bool isInOrder(Result result) {
+        return result == Result::First || result == Result::InOrder ||
+               result == Result::Gap || result == Result::Reset;
+    }
+
+private:
+    bool started_ = false;
+    uint32_t highest_ = 0;
+    uint64_t window_ = 0;  // Bit i set: highest_ - i was received (bit 0 = highest_)
+    SequenceStats stats_;
+};
+
+#endif // SEQUENCE_TRACKER_HPP
@@ -0,0 +1,72 @@
+/*
+ * Sharded Receiver
+ *
+ * Receives the event port with N UDPReceivers bound with SO_REUSEPORT, each
+ * polled by its own worker thread. The kernel hashes flows (source address and
+ * port) across the sockets, so every publisher lands on one shard and its
+ * sequence numbers are tracked there.
+ */
+
+#ifndef SHARDED_RECEIVER_HPP
+#define SHARDED_RECEIVER_HPP
+
+#include "udp_receiver.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class ShardedReceiver {
+public:
+    // Called once per shard before it is bound; install that shard's callbacks here.
+    // The callbacks then run on the shard's worker thread.
+    using ShardSetup = std::function<void(size_t shard, UDPReceiver& receiver)>;
+
+    struct ShardStats {
+        uint64_t datagrams = 0;  // Datagrams read by the shard
+        uint64_t syscalls = 0;   // recvmmsg() calls that returned data
+        uint64_t invalid = 0;    // Datagrams dropped for bad size, magic or version
+        int cpu = -1;            // CPU the worker is pinned to, -1 if not pinned
+    };
+
+    ShardedReceiver(unsigned short event_port, size_t shards);
+    ~ShardedReceiver();
+
+    void setShardSetup(ShardSetup setup) { setup_ = setup; }
+    // Pin shard i's worker to the i-th CPU the process may run on (wrapping around).
+    // Each worker pins itself before its first poll.
+    void setPinThreads(bool pin) { pin_threads_ = pin; }
+
+    // Bind every shard and start the workers
+    bool start();
+    // Stop and join the workers (also done by the destructor)
+    void stop();
+
+    size_t shardCount() const { return shards_.size(); }
+    // Counters are published by the workers after every poll; safe from any thread
+    ShardStats getShardStats(size_t shard) const;
+    ShardStats getTotalStats() const;
+
+private:
+    struct Shard {
+        std::unique_ptr<UDPReceiver> receiver;
+        std::thread worker;
+        std::atomic<uint64_t> datagrams{0};
+        std::atomic<uint64_t> syscalls{0};
+        std::atomic<uint64_t> invalid{0};
+        int target_cpu = -1;      // Set before the worker starts
+        std::atomic<int> cpu{-1};  // Set by the worker once pinned
+    };
+
+    unsigned short event_port_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    ShardSetup setup_;
+    bool pin_threads_ = false;
+    std::atomic<bool> running_{false};
+
+    void run(Shard& shard);
+};
+
+#endif // SHARDED_RECEIVER_HPP
@@ -0,0 +1,164 @@
+/*
+ * Shared-Memory Transport
+ *
+ * Same-host alternative to UDP loopback: ShmPublisher writes one frame per
+ * device report into a POSIX shared memory segment (shm_open), ShmReader maps
+ * it and reads them. No syscall per packet: the publisher only makes one
+ * FUTEX_WAKE per flush(), and only while a reader is blocked.
+ *
+ * The segment holds a single-writer, multi-reader ring of frames (v2 layout,
+ * sequence numbers per device) and a per-device state block. The ring never
+ * waits for readers: each slot is versioned like a seqlock, so a reader that
+ * falls more than a ring behind skips what was overwritten and counts it as
+ * lost. The state block holds every device's latest StatePacket behind a
+ * Seqlock, for readers that only want current values.
+ */
+
+#ifndef SHM_TRANSPORT_HPP
+#define SHM_TRANSPORT_HPP
+
+#include "seqlock.hpp"
+#include "xbox_udp_protocol.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace shm_transport {
+
+constexpr uint32_t SHM_MAGIC = 0x48534258;  // "XBSH" in little-endian
+constexpr uint32_t SHM_VERSION = 1;
+constexpr size_t DEFAULT_SLOTS = 1024;
+
+// Largest frame: all entries and the full edge history, in 8-byte words
+constexpr size_t SLOT_WORDS = (xbox_udp::frameSize(xbox_udp::MAX_FRAME_ENTRIES, xbox_udp::MAX_FRAME_HISTORY) + 7) / 8;
+
+struct alignas(64) Slot {
+    // 2 * (position + 1) once the frame at `position` is complete, odd while it is written
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> words[SLOT_WORDS];
+};
+
+struct Header {
+    std::atomic<uint32_t> magic;  // SHM_MAGIC, set last when the segment is ready
+    uint32_t version;             // SHM_VERSION
+    uint32_t slot_count;          // Ring size, a power of two
+    std::atomic<uint32_t> closed; // Set when the publisher goes away
+    alignas(64) std::atomic<uint64_t> write_pos;  // Frames published so far
+    alignas(64) std::atomic<uint32_t> futex;      // Bumped by every flush(); blocked readers wait on it
+    std::atomic<uint32_t> waiters;                // Readers in FUTEX_WAIT
+    std::array<Seqlock<xbox_udp::StatePacket>, 256> states;
+    // Slot slots[slot_count] follow, 64-byte aligned
+};
+
+// Segment size for a ring of `slots` slots
+size_t segmentSize(size_t slots);
+
+}  // namespace shm_transport
+
+class ShmPublisher {
+public:
+    struct Stats {
+        uint64_t frames = 0;   // Frames written to the ring
+        uint64_t flushes = 0;  // flush() calls that wrote frames
+        uint64_t wakeups = 0;  // FUTEX_WAKE syscalls (a reader was blocked)
+    };
+
+    // Create the segment /name (replacing a stale one) with a ring of `slots`
+    // frames, rounded up to a power of two. Readers that mapped a previous
+    // segment of that name see it closed.
+    explicit ShmPublisher(const std::string& name, size_t slots = shm_transport::DEFAULT_SLOTS);
+    ~ShmPublisher();
+    ShmPublisher(const ShmPublisher&) = delete;
+    ShmPublisher& operator=(const ShmPublisher&) = delete;
+
+    bool isOpen() const { return header_ != nullptr; }
+    const std::string& getName() const { return name_; }
+
+    // Add an event to its device's frame for the next flush()
+    bool queueEvent(const xbox_udp::InputEventPacket& pkt);
+    // Publish the queued frames and wake blocked readers (call at SYN_REPORT)
+    bool flush();
+    // Store a device's current state in the state block (immediately visible)
+    void publishState(const xbox_udp::StatePacket& state);
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    std::string name_;
+    shm_transport::Header* header_ = nullptr;
+    shm_transport::Slot* slots_ = nullptr;
+    size_t size_ = 0;
+    uint64_t write_pos_ = 0;
+    std::vector<xbox_udp::FramePacket> frames_;
+    std::array<int16_t, 256> open_frame_;  // device_id -> index into frames_, -1 if none
+    std::array<uint32_t, 256> next_seq_{};
+    Stats stats_;
+};
+
+class ShmReader {
+public:
+    struct Stats {
+        uint64_t frames = 0;  // Frames read
+        uint64_t lost = 0;    // Frames overwritten before they were read
+        uint64_t waits = 0;   // Blocking waits (FUTEX_WAIT calls)
+    };
+
+    explicit ShmReader(const std::string& name);
+    ~ShmReader();
+    ShmReader(const ShmReader&) = delete;
+    ShmReader& operator=(const ShmReader&) = delete;
+
+    // Map the segment; reading starts with the next frame published
+    bool open();
+    bool isOpen() const { return header_ != nullptr; }
+    // The publisher exited or was replaced; open() again to follow a new one
+    bool isClosed() const;
+
+    // Pass every new frame to handler.onFrame(const xbox_udp::FramePacket&). If
+    // there is none, wait up to timeout_ms (-1 = forever) for the next flush().
+    // Returns the number of frames delivered.
+    template <typename Handler>
+    size_t poll(Handler& handler, int timeout_ms = 0) {
+        size_t n = drain(handler);
+        if (n == 0 && timeout_ms != 0 && header_) {
+            wait(timeout_ms);
+            n = drain(handler);
+        }
+        return n;
+    }
+
+    // Latest state the publisher stored for a device; false if none yet
+    bool readState(uint8_t device_id, xbox_udp::StatePacket& out) const;
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    std::string name_;
+    shm_transport::Header* header_ = nullptr;
+    const shm_transport::Slot* slots_ = nullptr;
+    size_t size_ = 0;
+    uint64_t mask_ = 0;
+    uint64_t read_pos_ = 0;
+    xbox_udp::EventBuffer buf_;
+    Stats stats_;
+
+    void close();
+    // The next frame, copied into buf_, or nullptr if there is none
+    const xbox_udp::FramePacket* next();
+    void wait(int timeout_ms);
+
+    template <typename Handler>
+    size_t drain(Handler& handler) {
+        size_t n = 0;
+        while (const xbox_udp::FramePacket* frame = next()) {
+            handler.onFrame(*frame);
+            ++n;
+        }
+        return n;
+    }
+};
+
+#endif // SHM_TRANSPORT_HPP
@@ -0,0 +1,51 @@
+/*
+ * Socket Options Profile
+ *
+ * Latency-related socket options for the publisher's and receivers' sockets,
+ * set from the command line (--busy-poll, --priority, --dscp, --sndbuf,
+ * --rcvbuf, --rcvlowat) or from the `socket:` section of a YAML file.
+ * Unset options keep the kernel defaults. socket_util::applySocketOptions()
+ * applies a profile, socket_util::describeSocketOptions() reports what the
+ * kernel actually uses.
+ */
+
+#ifndef SOCKET_OPTIONS_HPP
+#define SOCKET_OPTIONS_HPP
+
+#include <string>
+
+namespace socket_util {
+
+// DSCP of Expedited Forwarding, the usual class for interactive low-latency traffic
+constexpr int DSCP_EF = 46;
+
+// -1 = leave the kernel default
+struct SocketOptions {
+    int busy_poll_us = -1;  // SO_BUSY_POLL: spin on the device queue this long before sleeping in a read
+    int priority = -1;      // SO_PRIORITY: queueing priority on the host (0-6 unprivileged)
+    int dscp = -1;          // IP_TOS = dscp << 2 (IPv4 sockets only)
+    int sndbuf = -1;        // SO_SNDBUF in bytes (the kernel doubles it for bookkeeping)
+    int rcvbuf = -1;        // SO_RCVBUF in bytes (likewise)
+    int rcvlowat = -1;      // SO_RCVLOWAT in bytes (stream sockets; ignored with a warning on UDP/Unix datagram sockets)
+
+    bool empty() const {
+        return busy_poll_us < 0 && priority < 0 && dscp < 0 && sndbuf < 0 && rcvbuf < 0 && rcvlowat < 0;
+    }
+};
+
+// A DSCP given as a number (0-63) or a name: EF, CS0-CS7, AF11-AF43
+bool parseDscp(const std::string& text, int& dscp);
+// "EF", "CS5", "AF41", ... or the number
+std::string dscpName(int dscp);
+
+// Set the option of command-line flag `name` without its dashes ("busy-poll",
+// "priority", "dscp", "sndbuf", "rcvbuf", "rcvlowat") from `value`
+bool setSocketOption(SocketOptions& options, const std::string& name, const std::string& value);
+
+// Override `options` with the keys of the `socket:` section of a YAML file
+// (busy_poll_us, priority, dscp, sndbuf, rcvbuf, rcvlowat)
+bool loadSocketOptions(const std::string& path, SocketOptions& options);
+
+}  // namespace socket_util
+
+#endif // SOCKET_OPTIONS_HPP
@@ -0,0 +1,67 @@
+/*
+ * Socket Utilities
+ *
+ * Small helpers shared by the UDP publisher and receiver.
+ */
+
+#ifndef SOCKET_UTIL_HPP
+#define SOCKET_UTIL_HPP
+
+#include "socket_options.hpp"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+
+namespace socket_util {
+
+// Endpoint prefix selecting a Unix-domain datagram socket: "unix:/run/x.sock",
+// or "unix:@name" for the abstract namespace (no file)
+constexpr const char* UNIX_PREFIX = "unix:";
+
+// An IPv4 or Unix-domain socket address
+struct Address {
+    union {
+        struct sockaddr sa;
+        struct sockaddr_in in;
+        struct sockaddr_un un;
+    };
+    socklen_t len;
+
+    Address();
+    int family() const { return sa.sa_family; }
+    bool operator==(const Address& other) const;
+    // "a.b.c.d:port" or "unix:/path"
+    std::string toString() const;
+};
+
+// True if `spec` names a Unix-domain endpoint (starts with UNIX_PREFIX)
+bool isUnixEndpoint(const std::string& spec);
+
+// Fill `addr` from "unix:/path", "unix:@name" or an IPv4 address in dotted-quad
+// form with `port` (host byte order)
+bool parseEndpoint(const std::string& spec, unsigned short port, Address& addr);
+
+// True if `addr` (network byte order) is an IPv4 multicast group (224.0.0.0/4)
+bool isMulticast(const struct in_addr& addr);
+
+// Fill `addr` with an IPv4 address in dotted-quad form and a port (host byte order)
+bool parseAddress(const std::string& host, unsigned short port, struct sockaddr_in& addr);
+
+// Resolve an interface given as an IPv4 address ("192.168.1.5") or a name ("eth0")
+// into `mreq`. An empty string selects the default interface.
+bool resolveInterface(const std::string& iface, struct ip_mreqn& mreq);
+
+// Set the options of `options` on `sock` (IP_TOS only on IPv4 sockets).
+// Buffer sizes above the sysctl limits need CAP_NET_ADMIN (SO_*BUFFORCE),
+// otherwise the kernel caps them. Failures are logged with `label` and the
+// remaining options still applied; false if any failed.
+bool applySocketOptions(int sock, const SocketOptions& options, const char* label);
+
+// The values the kernel uses for those options on `sock`, e.g.
+// "busy_poll 50 us, priority 6, dscp EF (46), sndbuf 425984, rcvbuf 425984, rcvlowat 1"
+std::string describeSocketOptions(int sock);
+
+}  // namespace socket_util
+
+#endif // SOCKET_UTIL_HPP
@@ -0,0 +1,62 @@
+/*
+ * State Snapshots
+ *
+ * Latest state of every controller for threads that poll instead of taking
+ * callbacks (e.g. a 1 kHz control loop). The network thread applies packets
+ * and publishes each device's state through a seqlock once per packet; any
+ * number of reader threads copy a consistent snapshot without locks.
+ */
+
+#ifndef STATE_SNAPSHOT_HPP
+#define STATE_SNAPSHOT_HPP
+
+#include "seqlock.hpp"
+#include "udp_receiver.hpp"
+#include "xbox_udp_protocol.hpp"
+#include <cstdint>
+#include <memory>
+
+// Same key and axis ranges as StatePacket
+struct ControllerSnapshot {
+    uint64_t timestamp_ns = 0;  // Timestamp of the newest event applied
+    uint64_t updates = 0;       // Packets applied so far
+    uint64_t buttons[xbox_udp::STATE_KEY_COUNT / 64] = {};  // Pressed keys (bit = code - STATE_KEY_BASE)
+    uint32_t axis_mask = 0;     // Axes that reported a value (bit = axis code)
+    int32_t axes[xbox_udp::STATE_AXIS_COUNT] = {};       // Raw axis values
+    double normalized[xbox_udp::STATE_AXIS_COUNT] = {};  // Normalized axis values
+
+    bool button(unsigned code) const {
+        return xbox_udp::stateHasKey(code) && xbox_udp::testStateBit(buttons, code - xbox_udp::STATE_KEY_BASE);
+    }
+};
+
+class StateSnapshots {
+public:
+    StateSnapshots();
+
+    // Publish everything `receiver` delivers (replaces its event, frame and state callbacks)
+    void attach(UDPReceiver& receiver);
+
+    // Writer side: one thread per device (the thread polling its receiver)
+    void apply(const xbox_udp::InputEventPacket& pkt);
+    void apply(const xbox_udp::FramePacket& frame);
+    void apply(const xbox_udp::StatePacket& state);
+
+    // Reader side, any thread: the device's latest state; false if it never sent anything
+    bool read(uint8_t device_id, ControllerSnapshot& out) const;
+    // Number of snapshots published for the device; cheap change detection for pollers
+    uint64_t version(uint8_t device_id) const { return slots_[device_id].published.version(); }
+
+private:
+    struct Slot {
+        Seqlock<ControllerSnapshot> published;
+        alignas(64) ControllerSnapshot working;  // Writer's copy, kept off the readers' cache lines
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+
+    static void applyEvent(ControllerSnapshot& snap, uint16_t type, uint16_t code, int32_t value, double normalized);
+    void publish(Slot& slot, uint64_t timestamp_ns);
+};
+
+#endif // STATE_SNAPSHOT_HPP
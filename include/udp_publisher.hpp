@@ -1,28 +1,263 @@
 /*
  * UDP Publisher
  * 
- * Sends controller input events over UDP.
+ * Sends controller input events over UDP, or over a Unix-domain datagram
+ * socket to a destination given as "unix:/path" (same-host consumers).
  */
 
 #ifndef UDP_PUBLISHER_HPP
 #define UDP_PUBLISHER_HPP
 
+#include "socket_util.hpp"
 #include "xbox_udp_protocol.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 class UDPPublisher {
 public:
+    // Maximum number of packets submitted (to each destination) by a single flush()
+    static constexpr size_t MAX_BATCH = 64;
+    // Most datagrams one UDP_SEGMENT message carries (the kernel's UDP_MAX_SEGMENTS)
+    static constexpr size_t MAX_SEGMENTS = 64;
+    // Most subscribers registered at once
+    static constexpr size_t MAX_SUBSCRIBERS = 32;
+    // Most distinct filters of full-rate subscribers, each encoded as its own stream
+    static constexpr size_t MAX_FILTERED_STREAMS = 8;
+    // A source that is not a subscriber gets at most one snapshot of a device per
+    // SNAPSHOT_INTERVAL_MS; at most MAX_SNAPSHOT_SOURCES such replies are tracked
+    static constexpr int SNAPSHOT_INTERVAL_MS = 1000;
+    static constexpr size_t MAX_SNAPSHOT_SOURCES = 64;
+
+    // Wire format used for queued events
+    enum class Format {
+        Event,    // One InputEventPacket per evdev event
+        Compact,  // One single-entry FramePacket (v2 layout) per evdev event
+        Frame     // One FramePacket per device per flush (i.e. per SYN_REPORT)
+    };
+
+    // Replacement for sendmmsg() in flush(), e.g. IoRingSender queueing the messages
+    // on an io_uring. Returns how many of the `count` messages it took (-1 = none).
+    // It must copy what it keeps: the buffers are reused as soon as it returns.
+    using Sender = std::function<int(int sock, struct mmsghdr* msgs, unsigned count, int flags)>;
+
+    struct Stats {
+        uint64_t datagrams = 0;  // Datagrams handed to the kernel (or to the Sender)
+        uint64_t syscalls = 0;   // send()/sendmmsg() calls made
+        uint64_t errors = 0;     // Failed or short sends
+        uint64_t segmented = 0;  // Messages the kernel split into several datagrams (UDP_SEGMENT)
+    };
+
+    // Applied when the destination is an IPv4 multicast group
+    struct MulticastOptions {
+        int ttl = 1;              // IP_MULTICAST_TTL (1 = local subnet only)
+        bool loopback = true;     // IP_MULTICAST_LOOP: also deliver to receivers on this host
+        std::string interface;    // IP_MULTICAST_IF: outgoing interface address or name ("" = routing table)
+    };
+
+    // The first destination, an IPv4 address with `port` or "unix:/path" (port
+    // unused). It fixes the socket family; add more of it with addDestination().
+    // Unix destinations are sent to with MSG_DONTWAIT: a receiver whose queue is
+    // full loses the packet (counted in Stats::errors) instead of stalling us.
     UDPPublisher(const std::string& dest_addr, unsigned short port);
+    UDPPublisher(const std::string& dest_addr, unsigned short port,
+                 const MulticastOptions& multicast);
     ~UDPPublisher();
     
+    // Also send everything to `dest_addr:port`. Packets are encoded once and
+    // submitted to all destinations in the same sendmmsg() batch.
+    bool addDestination(const std::string& dest_addr, unsigned short port);
+    size_t destinationCount() const { return dests_.size(); }
+
+    // Register, refresh or cancel a subscriber from a SubscribePacket received on
+    // the control port from `from` (IPv4 publishers only). Full-rate subscribers get every packet like a
+    // destination; rate-limited ones get state packets (see publishState()). Packets go
+    // to `from` itself. A registration from a fixed destination is ignored (it already
+    // gets everything); new ones beyond MAX_SUBSCRIBERS are rejected, as is a full-rate
+    // filter that would need a stream beyond MAX_FILTERED_STREAMS. `from` is not
+    // authenticated (UDP sources can be forged): only accept registrations where
+    // that is acceptable, as joystick does with --allow-subscribers.
+    bool handleSubscribe(const xbox_udp::SubscribePacket& pkt, const struct sockaddr_in& from);
+    size_t subscriberCount() const { return subscribers_.size(); }
+
+    // Record a device's current state for rate-limited subscribers. Nothing is sent
+    // here; flush() delivers it to each subscriber that is due and hasn't seen it.
+    void publishState(const xbox_udp::StatePacket& state);
+
+    // Answer a StateRequestPacket received on the control port from `from` with
+    // `state` (the device's current state), sent at once as a STATE_SNAPSHOT
+    // state packet to `from`. A subscriber with a filter gets the filtered state.
+    // Other sources are rate-limited (SNAPSHOT_INTERVAL_MS per device), so spoofed
+    // requests can't turn the publisher into a reflector; false if not sent. Call
+    // once per device the request selects.
+    bool sendSnapshot(const xbox_udp::StatePacket& state, const xbox_udp::StateRequestPacket& request,
+                      const struct sockaddr_in& from);
+
+    // Milliseconds until a rate-limited subscriber is due for a pending state
+    // (0 = now), or -1 if none is pending. Call flush() when it expires.
+    int subscriberTimeoutMs() const;
+
+    // Send a single packet immediately (one send() per call, or one sendmmsg() when fanning out)
     bool sendEvent(const xbox_udp::InputEventPacket& pkt);
+
+    // Queue a packet for the next flush(). Flushes automatically when the batch is full.
+    // In the frame formats the event is encoded as a FrameEntry instead.
+    bool queueEvent(const xbox_udp::InputEventPacket& pkt);
+
+    // Queue a full-state keyframe for the next flush()
+    bool queueState(const xbox_udp::StatePacket& state);
+
+    // Submit all queued packets/frames with a single sendmmsg() (call at EV_SYN/SYN_REPORT)
+    bool flush();
+
+    // Route flush() through `sender` (nullptr: back to sendmmsg()). sendEvent()
+    // and sendSnapshot() still send directly.
+    void setSender(Sender sender);
+
+    // UDP generic segmentation offload for flush(): consecutive packets of one size
+    // for the same receiver go to the kernel as one message, their buffers
+    // gathered and a UDP_SEGMENT cmsg giving the size (the last may be shorter),
+    // so the stack is traversed once and segments the datagrams at the end. IPv4
+    // only, not with a Sender; false if the kernel lacks it (before 4.18). If a
+    // segmented send is rejected anyway, it is turned off and the packets are
+    // resent one datagram per message.
+    bool setSegmentation(bool enable);
+    bool getSegmentation() const { return segmentation_; }
+
+    // Apply a socket options profile (DSCP marking, priority, buffer sizes) to
+    // the sending socket; false if the kernel refused any of them
+    bool setSocketOptions(const socket_util::SocketOptions& options);
+    // Effective values of those options, for a startup report
+    std::string describeSocketOptions() const;
+
+    void setFormat(Format format);
+    Format getFormat() const { return format_; }
+
+    // Frame formats: also carry the device's last `depth` button edges (up to
+    // MAX_FRAME_HISTORY) in every frame, so receivers can restore edges of lost frames
+    void setHistoryDepth(size_t depth);
+
+    size_t pending() const;
+    const Stats& getStats() const { return stats_; }
     bool isConnected() const { return sock_ >= 0; }
+    bool isMulticast() const { return multicast_; }
+    bool isUnix() const { return family_ == AF_UNIX; }
 
 private:
     int sock_;
+    int family_ = AF_INET;
+    int send_flags_ = 0;
     std::string dest_addr_;
     unsigned short port_;
+    bool multicast_ = false;
+    MulticastOptions multicast_options_;
+    // Connected to dests_[0] while it is the only destination; with several (or any
+    // subscriber) the socket is unconnected and every message carries its msg_name
+    bool connected_ = false;
+    std::vector<socket_util::Address> dests_;
+
+    // Ring of each device's most recent button edges
+    struct EdgeHistory {
+        xbox_udp::ButtonEdge edges[xbox_udp::MAX_FRAME_HISTORY];
+        uint8_t count = 0;
+        uint8_t next = 0;
+    };
+
+    // Encoder state of one packet stream. streams_[0] is unfiltered and feeds the
+    // destinations and unfiltered full-rate subscribers; every distinct subscriber
+    // filter adds one stream. An event is tested against each stream's filter and
+    // encoded once per stream that passes it, never once per receiver.
+    struct Stream {
+        bool filtered = false;
+        xbox_udp::SubscribeFilter filter;
+        std::vector<xbox_udp::InputEventPacket> queue;
+        std::vector<xbox_udp::FramePacket> frames;
+        std::vector<xbox_udp::StatePacket> states;
+        std::array<int16_t, 256> open_frame;  // device_id -> index into frames, -1 if none
+        std::array<uint32_t, 256> next_seq;   // device_id -> next frame/state sequence number
+        std::array<EdgeHistory, 256> history;
+        size_t first_iov = 0;  // This stream's packets in iovecs_ during a flush
+        size_t iov_count = 0;
+
+        Stream();
+        size_t pending() const { return queue.size() + frames.size() + states.size(); }
+        bool passes(uint8_t device_id, uint16_t type, uint16_t code) const {
+            return !filtered || xbox_udp::filterPasses(filter, device_id, type, code);
+        }
+    };
+
+    using Clock = std::chrono::steady_clock;
+    struct SentState {
+        uint32_t version = 0;  // LatestState::version last sent
+        uint32_t seq = 0;      // Next sequence number of this subscriber's state packets
+        xbox_udp::StatePacket last;  // Filtered state last sent (filtered subscribers)
+    };
+    struct Subscriber {
+        struct sockaddr_in addr;
+        uint16_t max_rate_hz = 0;
+        Clock::time_point expires;
+        Clock::time_point next_due;
+        bool filtered = false;
+        xbox_udp::SubscribeFilter filter;
+        Stream* stream = nullptr;  // Full-rate subscribers: the stream they receive
+        bool resend_all = true;    // Rate-limited: send every device's state at the next delivery
+        std::unordered_map<uint8_t, SentState> sent;
+    };
+    struct LatestState {
+        xbox_udp::StatePacket state;
+        uint32_t version = 0;  // Bumped by publishState()
+    };
+    std::vector<Subscriber> subscribers_;
+    std::unordered_map<uint8_t, LatestState> latest_states_;
+    // Snapshots recently sent to non-subscribers, for the per-source rate limit
+    struct SnapshotReply {
+        struct sockaddr_in addr;
+        uint8_t device_id;
+        Clock::time_point sent;
+    };
+    std::vector<SnapshotReply> snapshot_replies_;
+
+    Format format_ = Format::Event;
+    size_t history_depth_ = 0;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    // Per-subscriber state packets of the current flush and their addresses
+    std::vector<xbox_udp::StatePacket> sub_states_;
+    std::vector<struct sockaddr_in> sub_targets_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct mmsghdr> msgs_;
+    bool segmentation_ = false;
+    // UDP_SEGMENT cmsg of each segmented message in msgs_
+    union SegmentControl {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    };
+    std::vector<SegmentControl> controls_;
+    Sender sender_;
+    Stats stats_;
+
+    bool applyMulticastOptions(const MulticastOptions& multicast);
+    bool disconnect();
+    Stream* findStream(const xbox_udp::SubscribeFilter& filter);
+    void dropUnusedStreams();
+    bool startsPacket(const Stream& stream, uint8_t device_id) const;
+    void encodeEvent(Stream& stream, const xbox_udp::InputEventPacket& pkt);
+    bool snapshotAllowed(const struct sockaddr_in& addr, uint8_t device_id, Clock::time_point now);
+    bool stateDue(Subscriber& sub, uint8_t device_id, const LatestState& latest, xbox_udp::StatePacket& out);
+    void queueSubscriberStates(Clock::time_point now);
+    void addMessage(size_t iov, struct sockaddr* addr, socklen_t addr_len);
+    void addSegmented(size_t first, size_t count, struct sockaddr* addr, socklen_t addr_len);
+    void addStreamMessages();
+    void splitSegmented(size_t from);
+    bool submit();
+    void attachHistory(Stream& stream, xbox_udp::FramePacket& frame);
 };
 
 #endif // UDP_PUBLISHER_HPP
@@ -1,40 +1,534 @@
 /*
  * UDP Receiver
- * 
- * Receives controller input events and vibration commands over UDP.
+ *
+ * Receives controller input events and vibration commands over UDP. Input can
+ * instead arrive on a Unix-domain datagram socket (setUnixSocket()).
+ *
+ * UDPReceiverT<Handler> calls the handler's methods directly, so they can be
+ * inlined into the receive loop:
+ *
+ *   void onEvent(const xbox_udp::InputEventPacket&);
+ *   void onFrame(const xbox_udp::FramePacket&);
+ *   void onState(const xbox_udp::StatePacket&);
+ *   void onVibration(const xbox_udp::VibrationPacket&);
+ *   void onSubscribe(const xbox_udp::SubscribePacket&, const sockaddr_in& from);
+ *   void onStateRequest(const xbox_udp::StateRequestPacket&, const sockaddr_in& from);
+ *
+ * Derive from PacketHandler to get no-op defaults. The packets are views into
+ * the receive buffer, valid only during the call. UDPReceiver is the
+ * std::function callback API on top of it.
  */
 
 #ifndef UDP_RECEIVER_HPP
 #define UDP_RECEIVER_HPP
 
+#include "jitter_buffer.hpp"
+#include "latency_histogram.hpp"
+#include "sequence_tracker.hpp"
+#include "socket_options.hpp"
 #include "xbox_udp_protocol.hpp"
+#include <netinet/in.h>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
 
-class UDPReceiver {
+// Sockets, subscription, batching and sequence accounting shared by all handlers
+class UDPReceiverBase {
 public:
-    using EventCallback = std::function<void(const xbox_udp::InputEventPacket&)>;
-    using VibrationCallback = std::function<void(const xbox_udp::VibrationPacket&)>;
-    
-    UDPReceiver(unsigned short event_port, unsigned short vibration_port);
-    ~UDPReceiver();
-    
+    // Maximum number of datagrams read by a single recvmmsg() call
+    static constexpr size_t RECV_BATCH = 32;
+    // A ready socket is drained with up to this many recvmmsg() calls per poll(),
+    // so a flood on one socket can't starve the other
+    static constexpr size_t MAX_DRAIN_CALLS = 16;
+
+    struct ReceiveStats {
+        uint64_t datagrams = 0;  // Datagrams read from both sockets
+        uint64_t syscalls = 0;   // recvmmsg() calls that returned data
+        uint64_t invalid = 0;    // Datagrams dropped for bad size, magic or version
+        // batch_sizes[n]: recvmmsg() calls that returned n datagrams
+        std::array<uint64_t, RECV_BATCH + 1> batch_sizes{};
+    };
+
+    // Latencies of a device's input events and frames (CLOCK_REALTIME; across hosts
+    // the network figure is only as good as their clock sync)
+    struct LatencyStats {
+        LatencyHistogram network;  // Kernel RX time - evdev timestamp: publisher, stack and network
+        LatencyHistogram receive;  // Handler call - kernel RX time: socket queue, wakeup, batching
+    };
+
+    // A port of 0 disables the corresponding socket
+    UDPReceiverBase(unsigned short event_port, unsigned short vibration_port);
+    ~UDPReceiverBase();
+    UDPReceiverBase(const UDPReceiverBase&) = delete;
+    UDPReceiverBase& operator=(const UDPReceiverBase&) = delete;
+
+    // Join an IPv4 multicast group on the event socket when bind() is called.
+    // `iface` is a local address or interface name ("" = chosen by the kernel).
+    void setMulticastGroup(const std::string& group, const std::string& iface = "") {
+        multicast_group_ = group;
+        multicast_iface_ = iface;
+    }
+
+    // Bind the event socket to a Unix-domain datagram socket instead of the UDP
+    // event port: "unix:/path" (a stale socket file there is replaced, and removed
+    // again on destruction) or "unix:@name" in the abstract namespace. Publishers
+    // reach it with the same string as destination. Not for multicast, and
+    // subscribe()/requestState() need a UDP event socket.
+    void setUnixSocket(const std::string& endpoint) { unix_endpoint_ = endpoint; }
+
+    // Bind the event socket with SO_REUSEPORT, so several receivers (see
+    // ShardedReceiver) share the port and the kernel hashes flows across them
+    void setReusePort(bool reuse) { reuse_port_ = reuse; }
+
+    // Attach classic BPF socket filters on bind() (default on) that drop datagrams
+    // of the wrong size or magic in the kernel, before they wake up poll(). Those
+    // never reach userspace and so are not counted in ReceiveStats::invalid.
+    void setKernelFilter(bool enable) { kernel_filter_ = enable; }
+
+    // Enable SO_TIMESTAMPNS on the event socket on bind() and record per-device
+    // latency histograms of input events and frames (keyframes and state
+    // snapshots carry the time of the last change, not of sending, and are skipped)
+    void setLatencyStats(bool enable) { latency_stats_ = enable; }
+
+    // Socket options profile (busy polling, priority, buffer sizes) applied to
+    // both sockets on bind(); failures are logged and don't fail bind()
+    void setSocketOptions(const socket_util::SocketOptions& options) { socket_options_ = options; }
+    // Effective values of those options on the event socket (or the control
+    // socket if there is none), for a startup report; empty before bind()
+    std::string describeSocketOptions() const;
+
     bool bind();
-    void setEventCallback(EventCallback callback) { event_callback_ = callback; }
-    void setVibrationCallback(VibrationCallback callback) { vibration_callback_ = callback; }
-    
-    // Poll for incoming packets (non-blocking)
-    void poll(int timeout_ms = 0);
-    
-    bool isBound() const { return event_sock_ >= 0 && vib_sock_ >= 0; }
 
-private:
+    // Register with a publisher's control port (publisher data port + 1). Sent from
+    // the event socket, so data comes back to it; poll() refreshes the lease until
+    // unsubscribe(). max_rate_hz = 0 asks for every packet, otherwise for coalesced
+    // state packets at most that often. With a `filter` the publisher only sends the
+    // selected devices and key/axis codes. Call after bind().
+    bool subscribe(const std::string& publisher, unsigned short control_port,
+                   uint16_t max_rate_hz = 0, const xbox_udp::SubscribeFilter* filter = nullptr,
+                   uint32_t lease_ms = xbox_udp::DEFAULT_LEASE_MS);
+    void unsubscribe();
+
+    // Ask a publisher's control port for the current state of `device_id` (or all
+    // devices). The replies are state packets flagged STATE_SNAPSHOT, delivered to
+    // the event socket like keyframes. Call after bind(); one request, no retry.
+    bool requestState(const std::string& publisher, unsigned short control_port,
+                      uint8_t device_id = xbox_udp::STATE_REQUEST_ALL);
+
+    // Drop duplicate, reordered and stale frames/state packets instead of delivering them
+    void setDropOutOfOrder(bool drop) { drop_out_of_order_ = drop; }
+
+    const ReceiveStats& getReceiveStats() const { return recv_stats_; }
+
+    // Loss/duplicate/reorder accounting of frame and state packet sequence numbers.
+    // Sequences are tracked per (source address, device_id): two publishers numbering
+    // the same device id are tracked apart. Unbound Unix socket senders have no
+    // address and share one tracker per device. Sums over the device's sources.
+    SequenceStats getSequenceStats(uint8_t device_id) const;
+    SequenceStats getTotalSequenceStats() const;
+    uint64_t getDroppedOutOfOrder() const { return dropped_out_of_order_; }
+
+    // nullptr until an input packet of the device was received with setLatencyStats(true)
+    const LatencyStats* getLatencyStats(uint8_t device_id) const { return latency_[device_id].get(); }
+    void resetLatencyStats();
+
+    // The bound sockets (-1 if disabled or not bound), for external event loops
+    int eventSocket() const { return event_sock_; }
+    int controlSocket() const { return vib_sock_; }
+
+    bool isBound() const {
+        return (!hasEventSocket() || event_sock_ >= 0) && (vibration_port_ == 0 || vib_sock_ >= 0);
+    }
+
+protected:
+    // waitReady() result bits
+    static constexpr unsigned EVENT_READY = 0x1;
+    static constexpr unsigned CONTROL_READY = 0x2;
+
     int event_sock_;
     int vib_sock_;
+
+    // Refresh the subscription if due, then wait up to timeout_ms for readable sockets
+    unsigned waitReady(int timeout_ms);
+    // One recvmmsg() into the batch buffers; the number of datagrams read (0 if none)
+    size_t receiveBatch(int sock);
+    // Datagram i of the last batch, or nullptr (counted invalid) if it was truncated.
+    // Call in order: it also picks up the packet's kernel RX timestamp.
+    const void* batchPacket(size_t i, size_t& len);
+    const struct sockaddr_in& batchSource(size_t i) const { return recv_addrs_[i]; }
+    void countInvalid() { ++recv_stats_.invalid; }
+
+    bool latencyStatsEnabled() const { return latency_stats_; }
+    // Record the latencies of the current batchPacket() sent at timestamp_ns
+    void recordLatency(uint8_t device_id, uint64_t timestamp_ns);
+
+    // Tracker of device_id for the source of the current batchPacket()
+    SequenceTracker& sequenceTracker(uint8_t device_id);
+    bool acceptSequence(SequenceTracker& tracker, uint32_t seq);
+    // Replay the button edges a frame carries for the gap after prev_highest, as
+    // frames flagged FRAME_RECOVERED passed to `deliver`
+    template <typename Deliver>
+    void recoverEdges(const xbox_udp::FramePacket& frame, SequenceTracker& tracker, uint32_t prev_highest,
+                      Deliver&& deliver);
+
+private:
     unsigned short event_port_;
     unsigned short vibration_port_;
-    EventCallback event_callback_;
-    VibrationCallback vibration_callback_;
+    std::string unix_endpoint_;
+    std::string unix_path_;  // Socket file to remove on destruction, if still ours
+    dev_t unix_dev_ = 0;
+    ino_t unix_ino_ = 0;
+    std::string multicast_group_;
+    std::string multicast_iface_;
+    bool reuse_port_ = false;
+    bool kernel_filter_ = true;
+    socket_util::SocketOptions socket_options_;
+
+    bool subscribed_ = false;
+    struct sockaddr_in control_addr_;
+    xbox_udp::SubscribePacket subscription_;
+    std::chrono::steady_clock::time_point next_refresh_;
+
+    // Reusable recvmmsg() batch: aligned buffers for in-place reads, source addresses
+    std::vector<xbox_udp::EventBuffer> recv_bufs_;
+    std::vector<struct sockaddr_in> recv_addrs_;
+    std::vector<struct iovec> recv_iovecs_;
+    std::vector<struct mmsghdr> recv_msgs_;
+    ReceiveStats recv_stats_;
+
+    // SCM_TIMESTAMPNS control buffers of the batch, and the RX time of the packet
+    // last returned by batchPacket() (0 if it had none)
+    union ControlBuffer {
+        char data[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    };
+    bool latency_stats_ = false;
+    std::vector<ControlBuffer> recv_control_;
+    uint64_t packet_rx_ns_ = 0;
+    std::array<std::unique_ptr<LatencyStats>, 256> latency_;
+
+    // Source of the packet last returned by batchPacket(): IPv4 address and port,
+    // 0 if the sender had no address
+    uint64_t packet_source_ = 0;
+
+    // Per-device trackers, one per source; usually a single entry. The least recently
+    // used one is reused beyond MAX_SEQUENCE_SOURCES so spoofed sources cannot grow it.
+    static constexpr size_t MAX_SEQUENCE_SOURCES = 8;
+    struct SourceTracker {
+        uint64_t source;
+        uint64_t last_used;
+        SequenceTracker tracker;
+    };
+    std::array<std::vector<SourceTracker>, 256> trackers_;
+    uint64_t tracker_clock_ = 0;
+    bool drop_out_of_order_ = false;
+    uint64_t dropped_out_of_order_ = 0;
+
+    bool hasEventSocket() const { return event_port_ != 0 || !unix_endpoint_.empty(); }
+    bool bindEventSocket();
+    bool joinMulticastGroup();
+    bool sendSubscription();
+};
+
+// No-op handler methods; derive and redefine the ones you need
+struct PacketHandler {
+    void onEvent(const xbox_udp::InputEventPacket&) {}
+    void onFrame(const xbox_udp::FramePacket&) {}
+    void onState(const xbox_udp::StatePacket&) {}
+    void onVibration(const xbox_udp::VibrationPacket&) {}
+    void onSubscribe(const xbox_udp::SubscribePacket&, const struct sockaddr_in&) {}
+    void onStateRequest(const xbox_udp::StateRequestPacket&, const struct sockaddr_in&) {}
 };
 
+template <typename Handler>
+class UDPReceiverT : public UDPReceiverBase {
+public:
+    UDPReceiverT(unsigned short event_port, unsigned short vibration_port, Handler handler = Handler())
+        : UDPReceiverBase(event_port, vibration_port), handler_(std::move(handler)) {}
+
+    Handler& handler() { return handler_; }
+    const Handler& handler() const { return handler_; }
+
+    // Wait up to timeout_ms for packets, then drain every ready socket with
+    // recvmmsg() and dispatch all valid packets
+    void poll(int timeout_ms = 0) {
+        const unsigned ready = waitReady(timeout_ms);
+        if (ready & EVENT_READY) drain(event_sock_, false);
+        if (ready & CONTROL_READY) drain(vib_sock_, true);
+    }
+
+    // For an external event loop (e.g. io_uring) that watches eventSocket() and
+    // controlSocket() itself: drain one that became readable, without waiting.
+    // Subscriptions are not refreshed; use poll() for that.
+    void drainEventSocket() {
+        if (event_sock_ >= 0) drain(event_sock_, false);
+    }
+    void drainControlSocket() {
+        if (vib_sock_ >= 0) drain(vib_sock_, true);
+    }
+
+protected:
+    Handler handler_;
+
+private:
+    void drain(int sock, bool control);
+    void dispatchControl(const void* data, size_t len, const struct sockaddr_in& from);
+    void dispatchEvent(const void* data, size_t len);
+};
+
+// Handler forwarding to std::function callbacks (the UDPReceiver API)
+struct ReceiverCallbacks {
+    using EventCallback = std::function<void(const xbox_udp::InputEventPacket&)>;
+    using FrameCallback = std::function<void(const xbox_udp::FramePacket&)>;
+    using StateCallback = std::function<void(const xbox_udp::StatePacket&)>;
+    using VibrationCallback = std::function<void(const xbox_udp::VibrationPacket&)>;
+    using SubscribeCallback = std::function<void(const xbox_udp::SubscribePacket&,
+                                                 const struct sockaddr_in& from)>;
+    using StateRequestCallback = std::function<void(const xbox_udp::StateRequestPacket&,
+                                                    const struct sockaddr_in& from)>;
+
+    EventCallback event;
+    FrameCallback frame;
+    StateCallback state;
+    VibrationCallback vibration;
+    SubscribeCallback subscribe;
+    StateRequestCallback state_request;
+    // Input packets go through this jitter buffer first if set
+    JitterBuffer* jitter = nullptr;
+
+    // Sink for packets leaving the jitter buffer
+    struct Playout {
+        ReceiverCallbacks& callbacks;
+        void onEvent(const xbox_udp::InputEventPacket& pkt) { callbacks.deliverEvent(pkt); }
+        void onFrame(const xbox_udp::FramePacket& pkt) { callbacks.deliverFrame(pkt); }
+        void onState(const xbox_udp::StatePacket& pkt) { callbacks.deliverState(pkt); }
+    };
+
+    void onEvent(const xbox_udp::InputEventPacket& pkt) {
+        if (jitter) {
+            Playout playout{*this};
+            jitter->push(pkt, JitterBuffer::nowNs(), playout);
+        } else {
+            deliverEvent(pkt);
+        }
+    }
+    void onFrame(const xbox_udp::FramePacket& pkt) {
+        if (jitter) {
+            Playout playout{*this};
+            jitter->push(pkt, JitterBuffer::nowNs(), playout);
+        } else {
+            deliverFrame(pkt);
+        }
+    }
+    void onState(const xbox_udp::StatePacket& pkt) {
+        if (jitter) {
+            Playout playout{*this};
+            jitter->push(pkt, JitterBuffer::nowNs(), playout);
+        } else {
+            deliverState(pkt);
+        }
+    }
+    void onVibration(const xbox_udp::VibrationPacket& pkt) {
+        if (vibration) vibration(pkt);
+    }
+    void onSubscribe(const xbox_udp::SubscribePacket& pkt, const struct sockaddr_in& from) {
+        if (subscribe) subscribe(pkt, from);
+    }
+    void onStateRequest(const xbox_udp::StateRequestPacket& pkt, const struct sockaddr_in& from) {
+        if (state_request) state_request(pkt, from);
+    }
+
+    void deliverEvent(const xbox_udp::InputEventPacket& pkt) {
+        if (event) event(pkt);
+    }
+    void deliverFrame(const xbox_udp::FramePacket& pkt) {
+        if (frame) {
+            frame(pkt);
+        } else if (event) {
+            for (uint8_t i = 0; i < pkt.header.count; ++i) {
+                event(xbox_udp::frameEntryToEvent(pkt.header, pkt.entries[i]));
+            }
+        }
+    }
+    void deliverState(const xbox_udp::StatePacket& pkt) {
+        if (state) {
+            state(pkt);
+        } else if (event) {
+            xbox_udp::forEachStateEvent(pkt, event);
+        }
+    }
+};
+
+extern template class UDPReceiverT<ReceiverCallbacks>;
+
+class UDPReceiver : public UDPReceiverT<ReceiverCallbacks> {
+public:
+    using EventCallback = ReceiverCallbacks::EventCallback;
+    using FrameCallback = ReceiverCallbacks::FrameCallback;
+    using StateCallback = ReceiverCallbacks::StateCallback;
+    using VibrationCallback = ReceiverCallbacks::VibrationCallback;
+    using SubscribeCallback = ReceiverCallbacks::SubscribeCallback;
+    using StateRequestCallback = ReceiverCallbacks::StateRequestCallback;
+
+    // A port of 0 disables the corresponding socket
+    UDPReceiver(unsigned short event_port, unsigned short vibration_port)
+        : UDPReceiverT<ReceiverCallbacks>(event_port, vibration_port) {}
+
+    void setEventCallback(EventCallback callback) { handler_.event = callback; }
+    // Frames go to the frame callback if set, otherwise each entry is passed to the event callback
+    void setFrameCallback(FrameCallback callback) { handler_.frame = callback; }
+    // Keyframes go to the state callback if set, otherwise they are expanded into event callbacks
+    void setStateCallback(StateCallback callback) { handler_.state = callback; }
+    void setVibrationCallback(VibrationCallback callback) { handler_.vibration = callback; }
+    // Subscriber registrations arriving on the vibration (control) socket
+    void setSubscribeCallback(SubscribeCallback callback) { handler_.subscribe = callback; }
+    // State requests arriving on the vibration (control) socket
+    void setStateRequestCallback(StateRequestCallback callback) { handler_.state_request = callback; }
+
+    // Hold input packets in a jitter buffer and deliver them at their sender
+    // timestamp plus the configured delay; poll() wakes up for each playout time
+    void setJitterBuffer(const JitterBuffer::Config& config);
+    const JitterBuffer* getJitterBuffer() const { return jitter_.get(); }
+
+    // As UDPReceiverT::poll(), then deliver the packets whose playout time has come
+    void poll(int timeout_ms = 0);
+
+private:
+    std::unique_ptr<JitterBuffer> jitter_;
+};
+
+template <typename Deliver>
+void UDPReceiverBase::recoverEdges(const xbox_udp::FramePacket& frame, SequenceTracker& tracker,
+                                   uint32_t prev_highest, Deliver&& deliver) {
+    // The frame opened a gap after prev_highest. Edges from inside the gap are newer
+    // than anything delivered so far; replay them in order, one rebuilt frame per lost seq.
+    xbox_udp::FramePacket rebuilt;
+    rebuilt.header = frame.header;
+    rebuilt.header.count = 0;
+    rebuilt.header.history = 0;
+    rebuilt.header.flags = xbox_udp::FRAME_RECOVERED;
+
+    uint64_t recovered = 0;
+    const xbox_udp::ButtonEdge* edges = xbox_udp::frameHistory(frame);
+    for (uint8_t i = 0; i < frame.header.history; ++i) {
+        const xbox_udp::ButtonEdge& edge = edges[i];
+        if (static_cast<int32_t>(edge.seq - prev_highest) <= 0 ||
+            static_cast<int32_t>(frame.header.seq - edge.seq) <= 0) {
+            continue;
+        }
+        if (rebuilt.header.count > 0 &&
+            (rebuilt.header.seq != edge.seq || rebuilt.header.count == xbox_udp::MAX_FRAME_ENTRIES)) {
+            deliver(static_cast<const xbox_udp::FramePacket&>(rebuilt));
+            rebuilt.header.count = 0;
+        }
+        rebuilt.header.seq = edge.seq;
+        xbox_udp::FrameEntry& entry = rebuilt.entries[rebuilt.header.count++];
+        entry.type = edge.type;
+        entry.code = edge.code;
+        entry.value = edge.value;
+        xbox_udp::encodeNormalized(edge.value, entry);
+        ++recovered;
+    }
+    if (rebuilt.header.count > 0) {
+        deliver(static_cast<const xbox_udp::FramePacket&>(rebuilt));
+    }
+    tracker.addRecovered(recovered);
+}
+
+template <typename Handler>
+void UDPReceiverT<Handler>::drain(int sock, bool control) {
+    for (size_t call = 0; call < MAX_DRAIN_CALLS; ++call) {
+        const size_t n = receiveBatch(sock);
+        for (size_t i = 0; i < n; ++i) {
+            size_t len = 0;
+            const void* data = batchPacket(i, len);
+            if (!data) continue;
+            if (control) {
+                dispatchControl(data, len, batchSource(i));
+            } else {
+                dispatchEvent(data, len);
+            }
+        }
+        // A short batch means the queue is empty
+        if (n < RECV_BATCH) return;
+    }
+}
+
+template <typename Handler>
+void UDPReceiverT<Handler>::dispatchControl(const void* data, size_t len, const struct sockaddr_in& from) {
+    // Vibration commands, subscriber registrations and state requests share the vibration socket
+    uint32_t magic = 0;
+    if (len >= sizeof(magic)) {
+        std::memcpy(&magic, data, sizeof(magic));
+    }
+
+    if (magic == xbox_udp::VIBRATION_MAGIC && len == sizeof(xbox_udp::VibrationPacket)) {
+        handler_.onVibration(*static_cast<const xbox_udp::VibrationPacket*>(data));
+    } else if (magic == xbox_udp::SUBSCRIBE_MAGIC && len == sizeof(xbox_udp::SubscribePacket) &&
+               static_cast<const xbox_udp::SubscribePacket*>(data)->version == xbox_udp::SUBSCRIBE_VERSION) {
+        handler_.onSubscribe(*static_cast<const xbox_udp::SubscribePacket*>(data), from);
+    } else if (magic == xbox_udp::STATE_REQUEST_MAGIC && len == sizeof(xbox_udp::StateRequestPacket) &&
+               static_cast<const xbox_udp::StateRequestPacket*>(data)->version == xbox_udp::STATE_REQUEST_VERSION) {
+        handler_.onStateRequest(*static_cast<const xbox_udp::StateRequestPacket*>(data), from);
+    } else {
+        countInvalid();
+    }
+}
+
+template <typename Handler>
+void UDPReceiverT<Handler>::dispatchEvent(const void* data, size_t len) {
+    uint32_t magic = 0;
+    if (len >= sizeof(magic)) {
+        std::memcpy(&magic, data, sizeof(magic));
+    }
+
+    if (magic == xbox_udp::PACKET_MAGIC && len == sizeof(xbox_udp::InputEventPacket)) {
+        const auto& pkt = *static_cast<const xbox_udp::InputEventPacket*>(data);
+        if (latencyStatsEnabled()) recordLatency(pkt.device_id, xbox_udp::toTimestampNs(pkt.sec, pkt.usec));
+        handler_.onEvent(pkt);
+    } else if (magic == xbox_udp::FRAME_MAGIC && len >= xbox_udp::FRAME_HEADER_SIZE) {
+        // v2 frames are naturally aligned: read them in place from the receive buffer
+        const auto& frame = *static_cast<const xbox_udp::FramePacket*>(data);
+        if (frame.header.version != xbox_udp::FRAME_VERSION ||
+            frame.header.count == 0 || frame.header.count > xbox_udp::MAX_FRAME_ENTRIES ||
+            frame.header.history > xbox_udp::MAX_FRAME_HISTORY ||
+            len != xbox_udp::frameSize(frame.header.count, frame.header.history)) {
+            countInvalid();
+            return;
+        }
+        SequenceTracker& tracker = sequenceTracker(frame.header.device_id);
+        const bool started = tracker.isStarted();
+        const uint32_t prev_highest = tracker.highest();
+        if (!acceptSequence(tracker, frame.header.seq)) return;
+        if (latencyStatsEnabled()) recordLatency(frame.header.device_id, frame.header.timestamp_ns);
+        if (started && frame.header.history > 0 &&
+            static_cast<int32_t>(frame.header.seq - prev_highest) > 1) {
+            recoverEdges(frame, tracker, prev_highest,
+                         [this](const xbox_udp::FramePacket& rebuilt) { handler_.onFrame(rebuilt); });
+        }
+        handler_.onFrame(frame);
+    } else if (magic == xbox_udp::STATE_MAGIC && len == sizeof(xbox_udp::StatePacket)) {
+        const auto& state = *static_cast<const xbox_udp::StatePacket*>(data);
+        if (state.version != xbox_udp::STATE_VERSION) {
+            countInvalid();
+            return;
+        }
+        // Snapshots answer a state request outside the sequenced stream
+        if (!(state.flags & xbox_udp::STATE_SNAPSHOT) &&
+            !acceptSequence(sequenceTracker(state.device_id), state.seq)) {
+            return;
+        }
+        handler_.onState(state);
+    } else {
+        countInvalid();
+    }
+}
+
 #endif // UDP_RECEIVER_HPP
@@ -13,6 +13,43 @@ namespace xbox_udp {
 // Magic bytes for packet validation
 constexpr uint32_t PACKET_MAGIC = 0x31434258;  // "XBC1" in little-endian
 constexpr uint32_t VIBRATION_MAGIC = 0x56425258;  // "XRBV" in little-endian (Xbox Rumble Vibration)
+constexpr uint32_t FRAME_MAGIC = 0x46434258;  // "XBCF" in little-endian (one evdev report per packet)
+constexpr uint32_t STATE_MAGIC = 0x53434258;  // "XBCS" in little-endian (full controller state keyframe)
+constexpr uint32_t SUBSCRIBE_MAGIC = 0x42534258;  // "XBSB" in little-endian (subscriber registration)
+constexpr uint32_t STATE_REQUEST_MAGIC = 0x51534258;  // "XBSQ" in little-endian (state snapshot request)
+
+// Frame packet format version (FrameHeader::version).
+// v1 was packed with a double and sec/usec; v2 is naturally aligned (see below);
+// v3 adds the per-device sequence number; v4 the optional button edge history.
+constexpr uint8_t FRAME_VERSION = 4;
+
+// Maximum number of entries carried by one frame packet
+constexpr size_t MAX_FRAME_ENTRIES = 32;
+
+// Maximum number of redundant button edges carried by one frame packet
+constexpr size_t MAX_FRAME_HISTORY = 8;
+
+// State packet format version (StatePacket::version); v2 adds the sequence number
+constexpr uint8_t STATE_VERSION = 2;
+
+// Subscribe packet format version (SubscribePacket::version); v2 adds the filter
+constexpr uint8_t SUBSCRIBE_VERSION = 2;
+
+// State request packet format version (StateRequestPacket::version)
+constexpr uint8_t STATE_REQUEST_VERSION = 1;
+
+// Code ranges covered by subscriber filters: all evdev key codes (KEY_CNT) and
+// all absolute axes (ABS_CNT)
+constexpr uint16_t FILTER_KEY_COUNT = 0x300;
+constexpr uint16_t FILTER_ABS_COUNT = 0x40;
+
+// Key codes covered by the state packet button bitset: BTN_MISC (0x100) up to
+// 0x17f, i.e. the joystick, gamepad and digitizer buttons
+constexpr uint16_t STATE_KEY_BASE = 0x100;
+constexpr uint16_t STATE_KEY_COUNT = 128;
+
+// Axis codes covered by the state packet: ABS_X (0) .. ABS_HAT3Y (0x17)
+constexpr uint16_t STATE_AXIS_COUNT = 24;
 
 #pragma pack(push, 1)
 struct InputEventPacket {
@@ -35,8 +72,321 @@ struct VibrationPacket {
 };
 #pragma pack(pop)
 
+static_assert(sizeof(InputEventPacket) == 29, "InputEventPacket layout");
+
+// v2 layout: naturally aligned, no #pragma pack. A receiver can read these
+// structs in place from an 8-byte aligned receive buffer.
+//
+// Frames and state packets share one per-device sequence counter, incremented
+// once per datagram; it sits at offset 8 in both, followed by the timestamp at 16.
+//
+// Frame packet: all events of one evdev report (up to SYN_REPORT), sharing one
+// timestamp. On the wire the header is followed by exactly `count` entries and
+// then `history` button edges. A single event is sent as a one-entry frame (36 bytes).
+struct FrameHeader {
+    uint32_t magic;        // FRAME_MAGIC
+    uint8_t  version;      // FRAME_VERSION
+    uint8_t  device_id;    // Controller index (0, 1, ...)
+    uint8_t  count;        // Number of entries that follow (1..MAX_FRAME_ENTRIES)
+    uint8_t  history;      // Number of button edges after the entries (0..MAX_FRAME_HISTORY)
+    uint32_t seq;          // Per-device sequence number
+    uint32_t flags;        // FRAME_* flags; zero on the wire
+    uint64_t timestamp_ns; // Report timestamp (evdev clock) in nanoseconds
+};
+
+// FrameHeader::flags
+constexpr uint32_t FRAME_RECOVERED = 0x0001;  // Rebuilt by the receiver from button edge history
+
+// FrameEntry::flags
+constexpr uint16_t ENTRY_NORMALIZED = 0x0001;  // `normalized` holds a Q15 value
+
+// Q15 fixed point: NORMALIZED_SCALE == 1.0
+constexpr int32_t NORMALIZED_SCALE = 32767;
+
+struct FrameEntry {
+    uint16_t type;       // EV_KEY, EV_ABS, etc.
+    uint16_t code;       // Button/axis code
+    int32_t  value;      // Raw event value
+    int16_t  normalized; // Q15 normalized value in [-1.0, 1.0] if ENTRY_NORMALIZED is set
+    uint16_t flags;      // ENTRY_* flags
+};
+
+// Redundant history: one of the device's most recent button transitions from
+// earlier frames, so a receiver can restore an edge whose frame was lost.
+// Covers EV_KEY and the d-pad hat axes (ABS_HAT0X..ABS_HAT3Y).
+struct ButtonEdge {
+    uint32_t seq;    // Sequence number of the frame that carried the transition
+    uint16_t code;   // Button/axis code
+    uint8_t  type;   // EV_KEY or EV_ABS
+    int8_t   value;  // New value (0/1/2 for keys, -1/0/1 for hats)
+};
+
+struct FramePacket {
+    FrameHeader header;
+    FrameEntry  entries[MAX_FRAME_ENTRIES];
+    // Room for the edges; on the wire they directly follow entries[count - 1]
+    ButtonEdge  history_space[MAX_FRAME_HISTORY];
+};
+
+static_assert(sizeof(FrameHeader) == 24, "FrameHeader layout");
+static_assert(offsetof(FrameHeader, version) == 4, "FrameHeader layout");
+static_assert(offsetof(FrameHeader, device_id) == 5, "FrameHeader layout");
+static_assert(offsetof(FrameHeader, count) == 6, "FrameHeader layout");
+static_assert(offsetof(FrameHeader, seq) == 8, "FrameHeader layout");
+static_assert(offsetof(FrameHeader, timestamp_ns) == 16, "FrameHeader layout");
+static_assert(sizeof(FrameEntry) == 12, "FrameEntry layout");
+static_assert(offsetof(FrameEntry, value) == 4, "FrameEntry layout");
+static_assert(offsetof(FrameEntry, normalized) == 8, "FrameEntry layout");
+static_assert(offsetof(FrameEntry, flags) == 10, "FrameEntry layout");
+static_assert(sizeof(ButtonEdge) == 8, "ButtonEdge layout");
+static_assert(offsetof(FramePacket, entries) == sizeof(FrameHeader), "FramePacket layout");
+
+// State packet (keyframe): complete state of one controller. Sent periodically
+// between frames (deltas) so late joiners and lossy links converge without retransmits.
+struct StatePacket {
+    uint32_t magic;          // STATE_MAGIC
+    uint8_t  version;        // STATE_VERSION
+    uint8_t  device_id;      // Controller index (0, 1, ...)
+    uint16_t flags;          // STATE_* flags (zero in keyframes)
+    uint32_t seq;            // Per-device sequence number (shared with frames)
+    uint32_t axis_mask;      // Axes the device has (bit = axis code)
+    uint64_t timestamp_ns;   // Timestamp (evdev clock) of the newest event in this state
+    uint64_t key_mask[STATE_KEY_COUNT / 64];  // Keys the device has (bit = code - STATE_KEY_BASE)
+    uint64_t buttons[STATE_KEY_COUNT / 64];   // Keys currently pressed
+    uint32_t normalized_mask; // Axes whose `normalized` entry holds a Q15 value
+    uint32_t reserved2;      // Zero
+    int32_t  axes[STATE_AXIS_COUNT];        // Raw axis values
+    int16_t  normalized[STATE_AXIS_COUNT];  // Q15 normalized axis values
+};
+
+static_assert(sizeof(StatePacket) == 208, "StatePacket layout");
+static_assert(offsetof(StatePacket, seq) == 8, "StatePacket layout");
+static_assert(offsetof(StatePacket, axis_mask) == 12, "StatePacket layout");
+static_assert(offsetof(StatePacket, timestamp_ns) == 16, "StatePacket layout");
+static_assert(offsetof(StatePacket, key_mask) == 24, "StatePacket layout");
+static_assert(offsetof(StatePacket, buttons) == 40, "StatePacket layout");
+static_assert(offsetof(StatePacket, normalized_mask) == 56, "StatePacket layout");
+static_assert(offsetof(StatePacket, axes) == 64, "StatePacket layout");
+static_assert(offsetof(StatePacket, normalized) == 160, "StatePacket layout");
+
+// StatePacket::flags
+// Reply to a StateRequestPacket, sent outside the device's packet stream: `seq`
+// is not meaningful and receivers don't count it in sequence accounting
+constexpr uint16_t STATE_SNAPSHOT = 0x0001;
+
+// What a subscriber wants to receive, evaluated by the publisher before encoding.
+// An event passes if its device bit is set and, for EV_KEY/EV_ABS, its code bit;
+// other event types only need the device bit.
+struct SubscribeFilter {
+    uint64_t devices[256 / 64];            // bit = device_id
+    uint64_t keys[FILTER_KEY_COUNT / 64];  // bit = EV_KEY code
+    uint64_t axes[FILTER_ABS_COUNT / 64];  // bit = EV_ABS code
+};
+
+// Subscriber registration, sent to the publisher's control port (its vibration
+// port, i.e. data port + 1). The registration is a lease: the publisher forgets
+// the subscriber after `lease_ms` unless the packet is sent again. Subscribers
+// with a max rate get the latest StatePacket of each changed device at most
+// `max_rate_hz` times per second (with their own sequence numbers) instead of
+// every frame.
+struct SubscribePacket {
+    uint32_t magic;        // SUBSCRIBE_MAGIC
+    uint8_t  version;      // SUBSCRIBE_VERSION
+    uint8_t  flags;        // SUBSCRIBE_* flags
+    uint16_t event_port;   // Zero (ignored: delivery goes to the source of this packet)
+    uint16_t max_rate_hz;  // Maximum delivery rate (0 = full rate: every packet)
+    uint16_t reserved;     // Zero
+    uint32_t lease_ms;     // Requested lease (0 = DEFAULT_LEASE_MS)
+    SubscribeFilter filter;  // Applied if SUBSCRIBE_FILTER is set
+};
+
+static_assert(sizeof(SubscribeFilter) == 136, "SubscribeFilter layout");
+static_assert(sizeof(SubscribePacket) == 152, "SubscribePacket layout");
+static_assert(offsetof(SubscribePacket, lease_ms) == 12, "SubscribePacket layout");
+static_assert(offsetof(SubscribePacket, filter) == 16, "SubscribePacket layout");
+
+// SubscribePacket::flags
+constexpr uint8_t SUBSCRIBE_CANCEL = 0x01;  // Drop the registration now
+constexpr uint8_t SUBSCRIBE_FILTER = 0x02;  // Only deliver what `filter` selects
+
+// Lease bounds applied by the publisher; subscribers refresh every lease / 3
+constexpr uint32_t DEFAULT_LEASE_MS = 10000;
+constexpr uint32_t MIN_LEASE_MS = 1000;
+constexpr uint32_t MAX_LEASE_MS = 300000;
+
+// Asks the publisher for the current state of one or all devices, sent to its
+// control port like a SubscribePacket. The publisher answers from the state it
+// keeps per device with one StatePacket flagged STATE_SNAPSHOT per device, so a
+// receiver that starts while the controllers are in use doesn't show released
+// buttons and centered axes until each of them moves.
+struct StateRequestPacket {
+    uint32_t magic;        // STATE_REQUEST_MAGIC
+    uint8_t  version;      // STATE_REQUEST_VERSION
+    uint8_t  device_id;    // Device to report, or STATE_REQUEST_ALL
+    uint16_t reply_port;   // Zero (ignored: the reply goes to the source of this packet)
+};
+
+static_assert(sizeof(StateRequestPacket) == 8, "StateRequestPacket layout");
+
+// StateRequestPacket::device_id asking for every device
+constexpr uint8_t STATE_REQUEST_ALL = 0xFF;
+
 constexpr size_t PACKET_SIZE = sizeof(InputEventPacket);
 constexpr size_t VIBRATION_PACKET_SIZE = sizeof(VibrationPacket);
+constexpr size_t FRAME_HEADER_SIZE = sizeof(FrameHeader);
+constexpr size_t FRAME_ENTRY_SIZE = sizeof(FrameEntry);
+constexpr size_t BUTTON_EDGE_SIZE = sizeof(ButtonEdge);
+constexpr size_t STATE_PACKET_SIZE = sizeof(StatePacket);
+constexpr size_t SUBSCRIBE_PACKET_SIZE = sizeof(SubscribePacket);
+constexpr size_t STATE_REQUEST_PACKET_SIZE = sizeof(StateRequestPacket);
+
+// Size on the wire of a frame carrying `count` entries and `history` button edges
+constexpr size_t frameSize(size_t count, size_t history = 0) {
+    return FRAME_HEADER_SIZE + count * FRAME_ENTRY_SIZE + history * BUTTON_EDGE_SIZE;
+}
+
+// Button edges of a frame (entries are 4-byte aligned, so the edges are too)
+inline ButtonEdge* frameHistory(FramePacket& frame) {
+    return reinterpret_cast<ButtonEdge*>(&frame.entries[frame.header.count]);
+}
+
+inline const ButtonEdge* frameHistory(const FramePacket& frame) {
+    return reinterpret_cast<const ButtonEdge*>(&frame.entries[frame.header.count]);
+}
+
+// Events whose transitions are kept in the button edge history
+inline bool isButtonEdge(uint16_t type, uint16_t code) {
+    return type == 0x01 ||                            // EV_KEY
+           (type == 0x03 && code >= 0x10 && code <= 0x17);  // EV_ABS, ABS_HAT0X..ABS_HAT3Y
+}
+
+// Receive buffer large enough for any event-port packet, aligned for in-place reads
+struct alignas(8) EventBuffer {
+    unsigned char data[sizeof(FramePacket)];
+};
+static_assert(sizeof(EventBuffer) >= sizeof(StatePacket), "EventBuffer size");
+
+inline uint64_t toTimestampNs(uint32_t sec, uint32_t usec) {
+    return static_cast<uint64_t>(sec) * 1000000000ull + static_cast<uint64_t>(usec) * 1000ull;
+}
+
+// Fill an entry's normalized/flags fields. Values outside [-1.0, 1.0] (raw
+// pass-through of unnormalized axes, key repeat) are not encoded; decoders fall
+// back to the raw value, which is what the publisher put there in the first place.
+inline bool toQ15(double normalized, int16_t& out) {
+    if (normalized >= -1.0 && normalized <= 1.0) {
+        double scaled = normalized * NORMALIZED_SCALE;
+        out = static_cast<int16_t>(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+        return true;
+    }
+    out = 0;
+    return false;
+}
+
+inline void encodeNormalized(double normalized, FrameEntry& entry) {
+    entry.flags = toQ15(normalized, entry.normalized) ? ENTRY_NORMALIZED : 0;
+}
+
+inline double decodeNormalized(const FrameEntry& entry) {
+    if (entry.flags & ENTRY_NORMALIZED) {
+        return static_cast<double>(entry.normalized) / NORMALIZED_SCALE;
+    }
+    return static_cast<double>(entry.value);
+}
+
+// Expand one frame entry into a per-event packet
+inline InputEventPacket frameEntryToEvent(const FrameHeader& header, const FrameEntry& entry) {
+    InputEventPacket pkt;
+    pkt.magic = PACKET_MAGIC;
+    pkt.device_id = header.device_id;
+    pkt.type = entry.type;
+    pkt.code = entry.code;
+    pkt.value = entry.value;
+    pkt.normalized = decodeNormalized(entry);
+    pkt.sec = static_cast<uint32_t>(header.timestamp_ns / 1000000000ull);
+    pkt.usec = static_cast<uint32_t>((header.timestamp_ns % 1000000000ull) / 1000ull);
+    return pkt;
+}
+
+inline bool stateHasKey(unsigned code) {
+    return code >= STATE_KEY_BASE && code < STATE_KEY_BASE + STATE_KEY_COUNT;
+}
+
+inline bool testStateBit(const uint64_t* bits, unsigned index) {
+    return (bits[index / 64] >> (index % 64)) & 1u;
+}
+
+inline void setStateBit(uint64_t* bits, unsigned index, bool on) {
+    const uint64_t bit = uint64_t(1) << (index % 64);
+    if (on) {
+        bits[index / 64] |= bit;
+    } else {
+        bits[index / 64] &= ~bit;
+    }
+}
+
+// Filter selecting everything: all devices, keys and axes
+inline void setFilterAll(SubscribeFilter& filter) {
+    for (auto& bits : filter.devices) bits = ~uint64_t(0);
+    for (auto& bits : filter.keys) bits = ~uint64_t(0);
+    for (auto& bits : filter.axes) bits = ~uint64_t(0);
+}
+
+inline bool filterPasses(const SubscribeFilter& filter, uint8_t device_id, uint16_t type, uint16_t code) {
+    if (!testStateBit(filter.devices, device_id)) return false;
+    if (type == 0x01) return code < FILTER_KEY_COUNT && testStateBit(filter.keys, code);  // EV_KEY
+    if (type == 0x03) return code < FILTER_ABS_COUNT && testStateBit(filter.axes, code);  // EV_ABS
+    return true;
+}
+
+// Restrict a state packet to the keys and axes a filter selects
+inline void filterState(const SubscribeFilter& filter, StatePacket& state) {
+    for (unsigned i = 0; i < STATE_KEY_COUNT; ++i) {
+        if (!testStateBit(filter.keys, STATE_KEY_BASE + i)) {
+            setStateBit(state.key_mask, i, false);
+            setStateBit(state.buttons, i, false);
+        }
+    }
+    for (unsigned i = 0; i < STATE_AXIS_COUNT; ++i) {
+        if (!testStateBit(filter.axes, i)) {
+            state.axis_mask &= ~(1u << i);
+            state.normalized_mask &= ~(1u << i);
+            state.axes[i] = 0;
+            state.normalized[i] = 0;
+        }
+    }
+}
+
+// Expand a state packet into per-event packets (EV_KEY for every key the device
+// has, then EV_ABS for every axis) and pass each to `fn`
+template <typename Fn>
+void forEachStateEvent(const StatePacket& state, Fn&& fn) {
+    InputEventPacket pkt;
+    pkt.magic = PACKET_MAGIC;
+    pkt.device_id = state.device_id;
+    pkt.sec = static_cast<uint32_t>(state.timestamp_ns / 1000000000ull);
+    pkt.usec = static_cast<uint32_t>((state.timestamp_ns % 1000000000ull) / 1000ull);
+
+    pkt.type = 0x01;  // EV_KEY
+    for (unsigned i = 0; i < STATE_KEY_COUNT; ++i) {
+        if (!testStateBit(state.key_mask, i)) continue;
+        pkt.code = static_cast<uint16_t>(STATE_KEY_BASE + i);
+        pkt.value = testStateBit(state.buttons, i) ? 1 : 0;
+        pkt.normalized = pkt.value;
+        fn(static_cast<const InputEventPacket&>(pkt));
+    }
+
+    pkt.type = 0x03;  // EV_ABS
+    for (unsigned i = 0; i < STATE_AXIS_COUNT; ++i) {
+        if (!((state.axis_mask >> i) & 1u)) continue;
+        pkt.code = static_cast<uint16_t>(i);
+        pkt.value = state.axes[i];
+        pkt.normalized = ((state.normalized_mask >> i) & 1u)
+            ? static_cast<double>(state.normalized[i]) / NORMALIZED_SCALE
+            : static_cast<double>(state.axes[i]);
+        fn(static_cast<const InputEventPacket&>(pkt));
+    }
+}
 
 // Default UDP port for publisher (send) and receiver (bind)
 constexpr unsigned short DEFAULT_PORT = 35555;
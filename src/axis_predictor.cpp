@@ -0,0 +1,143 @@
+/*
+ * Axis Predictor Implementation
+ */
+
+#include "axis_predictor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+AxisPredictor::AxisPredictor(const Config& config)
+    : config_(config), max_gap_ns_(static_cast<uint64_t>(config.max_gap_us) * 1000) {}
+
+uint64_t AxisPredictor::nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+AxisPredictor::Device& AxisPredictor::device(uint8_t device_id) {
+    std::unique_ptr<Device>& dev = devices_[device_id];
+    if (!dev) dev.reset(new Device());
+    return *dev;
+}
+
+void AxisPredictor::startReport(Device& dev, uint64_t timestamp_ns) {
+    // Axes the previous report didn't carry kept their value over that interval
+    uint64_t stopped = dev.moving & ~dev.updated;
+    while (stopped) {
+        const unsigned code = static_cast<unsigned>(__builtin_ctzll(stopped));
+        stopped &= stopped - 1;
+        dev.axes[code].velocity = 0.0;
+        dev.axes[code].velocity_norm = 0.0;
+    }
+    dev.moving &= dev.updated;
+
+    if (dev.report_ns != 0 && timestamp_ns - dev.report_ns <= max_gap_ns_) {
+        // Longer gaps are mostly lost reports or still sticks: let them move the
+        // estimate only slowly, enough to follow a device that reports less often
+        const double interval = static_cast<double>(timestamp_ns - dev.report_ns);
+        if (dev.interval_ns <= 0.0) {
+            dev.interval_ns = interval;
+        } else {
+            const double weight = interval <= config_.late_factor * dev.interval_ns ? 1.0 / 8 : 1.0 / 64;
+            dev.interval_ns += weight * (interval - dev.interval_ns);
+        }
+    }
+    dev.report_ns = timestamp_ns;
+    dev.updated = 0;
+}
+
+void AxisPredictor::observe(const xbox_udp::InputEventPacket& pkt, uint64_t now_ns, bool normalized) {
+    Device& dev = device(pkt.device_id);
+    const uint64_t timestamp_ns = xbox_udp::toTimestampNs(pkt.sec, pkt.usec);
+    if (timestamp_ns > dev.report_ns) {
+        startReport(dev, timestamp_ns);
+    }
+    dev.arrival_ns = std::max(dev.arrival_ns, now_ns);
+
+    if (pkt.type != 0x03 || pkt.code >= AXIS_COUNT) return;  // EV_ABS
+    Track& track = dev.axes[pkt.code];
+    if (timestamp_ns <= track.timestamp_ns) return;  // Stale or duplicate
+
+    const uint64_t bit = 1ull << pkt.code;
+    const uint64_t dt = timestamp_ns - track.timestamp_ns;
+    if ((config_.axes & bit) && track.timestamp_ns != 0 && dt <= max_gap_ns_) {
+        const double velocity = (pkt.value - track.value) / static_cast<double>(dt);
+        const double velocity_norm = (pkt.normalized - track.normalized) / static_cast<double>(dt);
+        if (dev.moving & bit) {
+            track.velocity += config_.velocity_alpha * (velocity - track.velocity);
+            track.velocity_norm += config_.velocity_alpha * (velocity_norm - track.velocity_norm);
+        } else {
+            // Starting from rest: the first sample is all there is
+            track.velocity = velocity;
+            track.velocity_norm = velocity_norm;
+        }
+    } else {
+        track.velocity = 0.0;
+        track.velocity_norm = 0.0;
+    }
+    track.timestamp_ns = timestamp_ns;
+    track.value = pkt.value;
+    track.normalized = pkt.normalized;
+    track.is_normalized = normalized;
+
+    dev.updated |= bit;
+    if (track.velocity != 0.0 || track.velocity_norm != 0.0) {
+        dev.moving |= bit;
+    } else {
+        dev.moving &= ~bit;
+    }
+}
+
+void AxisPredictor::reset(const xbox_udp::InputEventPacket& pkt, bool normalized) {
+    if (pkt.type != 0x03 || pkt.code >= AXIS_COUNT) return;  // EV_ABS
+    Device& dev = device(pkt.device_id);
+    Track& track = dev.axes[pkt.code];
+    const uint64_t timestamp_ns = xbox_udp::toTimestampNs(pkt.sec, pkt.usec);
+    if (timestamp_ns < track.timestamp_ns) return;
+    track.timestamp_ns = timestamp_ns;
+    track.value = pkt.value;
+    track.normalized = pkt.normalized;
+    track.is_normalized = normalized;
+    track.velocity = 0.0;
+    track.velocity_norm = 0.0;
+    dev.moving &= ~(1ull << pkt.code);
+}
+
+uint64_t AxisPredictor::predict(uint8_t device_id, uint64_t now_ns, int32_t* values, double* normalized) const {
+    const Device* dev = devices_[device_id].get();
+    if (!dev || dev->moving == 0 || dev->interval_ns <= 0.0 || now_ns <= dev->arrival_ns) return 0;
+
+    const double elapsed = static_cast<double>(now_ns - dev->arrival_ns);
+    if (elapsed <= config_.late_factor * dev->interval_ns) return 0;
+    const double horizon = std::min(elapsed, config_.max_intervals * dev->interval_ns);
+
+    uint64_t mask = dev->moving;
+    while (mask) {
+        const unsigned code = static_cast<unsigned>(__builtin_ctzll(mask));
+        mask &= mask - 1;
+        const Track& track = dev->axes[code];
+        // From the axis' last value, which may predate the newest report
+        double dt = horizon + static_cast<double>(dev->report_ns - track.timestamp_ns);
+        if (!track.is_normalized) {
+            // Raw pass-through: the normalized slot mirrors the raw value, as decoded
+            values[code] = static_cast<int32_t>(std::lround(track.value + track.velocity * dt));
+            normalized[code] = values[code];
+            continue;
+        }
+        double norm = track.normalized + track.velocity_norm * dt;
+        if (norm > 1.0 || norm < -1.0) {
+            // Stop at the end of the range, and stop the raw value at the same time
+            norm = norm > 1.0 ? 1.0 : -1.0;
+            dt = track.velocity_norm != 0.0 ? (norm - track.normalized) / track.velocity_norm : 0.0;
+        }
+        normalized[code] = norm;
+        values[code] = static_cast<int32_t>(std::lround(track.value + track.velocity * dt));
+    }
+    return dev->moving;
+}
+
+uint32_t AxisPredictor::intervalUs(uint8_t device_id) const {
+    const Device* dev = devices_[device_id].get();
+    return dev ? static_cast<uint32_t>(dev->interval_ns / 1000.0) : 0;
+}
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <algorithm>
 #include <cstring>
+#include <ctime>
 #include <iostream>
 
 // Helper macro for testing bits
@@ -17,6 +18,7 @@
 
 ControllerBase::ControllerBase(ControllerHandle handle) 
     : handle_(std::move(handle)), device_id_(0) {
+    initState();
 }
 
 ControllerBase::~ControllerBase() = default;
@@ -46,6 +48,90 @@ double ControllerBase::normalizeAxisValue(unsigned code, int32_t raw_value) cons
     return handle_.config->normalizeAxis(code, raw_value);
 }
 
+void ControllerBase::initState() {
+    std::memset(&state_, 0, sizeof(state_));
+    state_.magic = xbox_udp::STATE_MAGIC;
+    state_.version = xbox_udp::STATE_VERSION;
+    state_.device_id = device_id_;
+    
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    state_.timestamp_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+                          static_cast<uint64_t>(now.tv_nsec);
+    
+    // Seed with the device's current state so the first keyframe is already correct
+    if (!handle_.dev) return;
+    for (unsigned i = 0; i < xbox_udp::STATE_KEY_COUNT; ++i) {
+        unsigned code = xbox_udp::STATE_KEY_BASE + i;
+        if (!libevdev_has_event_code(handle_.dev, EV_KEY, code)) continue;
+        xbox_udp::setStateBit(state_.key_mask, i, true);
+        xbox_udp::setStateBit(state_.buttons, i, libevdev_get_event_value(handle_.dev, EV_KEY, code) != 0);
+    }
+    for (unsigned code = 0; code < xbox_udp::STATE_AXIS_COUNT; ++code) {
+        if (!libevdev_has_event_code(handle_.dev, EV_ABS, code)) continue;
+        int32_t value = libevdev_get_event_value(handle_.dev, EV_ABS, code);
+        state_.axis_mask |= 1u << code;
+        state_.axes[code] = value;
+        if (xbox_udp::toQ15(normalizeAxisValue(code, value), state_.normalized[code])) {
+            state_.normalized_mask |= 1u << code;
+        }
+    }
+}
+
+void ControllerBase::resyncEvents(std::vector<struct input_event>& out) const {
+    if (handle_.fd < 0) return;
+
+    struct input_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ev.time.tv_sec = now.tv_sec;
+    ev.time.tv_usec = now.tv_nsec / 1000;
+
+    unsigned long keys[KEY_MAX / BITS_PER_LONG + 1] = {0};
+    if (ioctl(handle_.fd, EVIOCGKEY(sizeof(keys)), keys) >= 0) {
+        ev.type = EV_KEY;
+        for (unsigned i = 0; i < xbox_udp::STATE_KEY_COUNT; ++i) {
+            if (!xbox_udp::testStateBit(state_.key_mask, i)) continue;
+            const unsigned code = xbox_udp::STATE_KEY_BASE + i;
+            const bool pressed = test_bit(code, keys);
+            if (pressed == xbox_udp::testStateBit(state_.buttons, i)) continue;
+            ev.code = static_cast<uint16_t>(code);
+            ev.value = pressed ? 1 : 0;
+            out.push_back(ev);
+        }
+    }
+
+    ev.type = EV_ABS;
+    for (unsigned code = 0; code < xbox_udp::STATE_AXIS_COUNT; ++code) {
+        if (!((state_.axis_mask >> code) & 1u)) continue;
+        struct input_absinfo abs;
+        if (ioctl(handle_.fd, EVIOCGABS(code), &abs) < 0 || abs.value == state_.axes[code]) continue;
+        ev.code = static_cast<uint16_t>(code);
+        ev.value = abs.value;
+        out.push_back(ev);
+    }
+}
+
+void ControllerBase::updateState(const xbox_udp::InputEventPacket& pkt) {
+    if (pkt.type == EV_KEY && xbox_udp::stateHasKey(pkt.code)) {
+        unsigned i = pkt.code - xbox_udp::STATE_KEY_BASE;
+        xbox_udp::setStateBit(state_.key_mask, i, true);
+        xbox_udp::setStateBit(state_.buttons, i, pkt.value != 0);
+    } else if (pkt.type == EV_ABS && pkt.code < xbox_udp::STATE_AXIS_COUNT) {
+        state_.axis_mask |= 1u << pkt.code;
+        state_.axes[pkt.code] = pkt.value;
+        if (xbox_udp::toQ15(pkt.normalized, state_.normalized[pkt.code])) {
+            state_.normalized_mask |= 1u << pkt.code;
+        } else {
+            state_.normalized_mask &= ~(1u << pkt.code);
+        }
+    } else {
+        return;
+    }
+    state_.timestamp_ns = xbox_udp::toTimestampNs(pkt.sec, pkt.usec);
+}
+
 // XboxController implementation
 XboxController::XboxController(ControllerHandle handle)
     : ControllerBase(std::move(handle)), current_effect_id_(-1) {
@@ -71,6 +157,7 @@ bool XboxController::processEvent(const struct input_event& ev, xbox_udp::InputE
         pkt.normalized = static_cast<double>(ev.value);
     }
     
+    updateState(pkt);
     return true;
 }
 
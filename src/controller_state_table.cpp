@@ -0,0 +1,142 @@
+/*
+ * Controller State Table Implementation
+ */
+
+#include "controller_state_table.hpp"
+#include "controller_config.hpp"
+#include <algorithm>
+#include <iostream>
+
+ControllerStateTable::ControllerStateTable(std::shared_ptr<const ControllerConfig> config) {
+    active_.reserve(MAX_DEVICES);
+    setConfig(std::move(config));
+}
+
+void ControllerStateTable::setConfig(std::shared_ptr<const ControllerConfig> config) {
+    config_ = std::move(config);
+    dpad_entries_.clear();
+    dpad_begin_.fill(0);
+    for (auto& bits : dpad_axis_bits_) bits.reset();
+    if (!config_) return;
+
+    const std::vector<DpadButtonMapping>& mappings = config_->getDpadButtonMappings();
+    if (mappings.size() > MAX_DPAD_BUTTONS) {
+        std::cerr << "ControllerStateTable: only the first " << MAX_DPAD_BUTTONS
+                  << " dpad buttons of " << config_->getName() << " are tracked" << std::endl;
+    }
+
+    // Group the dpad buttons by axis so an axis event only looks at its own buttons
+    std::array<uint8_t, AXIS_COUNT> counts{};
+    const size_t tracked = std::min(mappings.size(), MAX_DPAD_BUTTONS);
+    for (size_t i = 0; i < tracked; ++i) {
+        if (mappings[i].axis_code < AXIS_COUNT) ++counts[mappings[i].axis_code];
+    }
+    for (unsigned code = 0; code < AXIS_COUNT; ++code) {
+        dpad_begin_[code + 1] = static_cast<uint8_t>(dpad_begin_[code] + counts[code]);
+    }
+    dpad_entries_.resize(dpad_begin_[AXIS_COUNT]);
+    std::array<uint8_t, AXIS_COUNT> next = {};
+    for (size_t i = 0; i < tracked; ++i) {
+        const unsigned code = mappings[i].axis_code;
+        if (code >= AXIS_COUNT) continue;
+        dpad_entries_[dpad_begin_[code] + next[code]++] = {mappings[i].value, static_cast<uint8_t>(i)};
+        dpad_axis_bits_[code].set(i);
+    }
+}
+
+ControllerStateTable::DeviceState& ControllerStateTable::deviceState(uint8_t device_id) {
+    std::unique_ptr<DeviceState>& state = devices_[device_id];
+    if (!state) {
+        state.reset(new DeviceState());
+        active_.push_back(device_id);
+    }
+    return *state;
+}
+
+void ControllerStateTable::setPrediction(const AxisPredictor::Config& config) {
+    predictor_.reset(new AxisPredictor(config));
+}
+
+void ControllerStateTable::apply(const xbox_udp::InputEventPacket& pkt) {
+    applyEvent(pkt);
+    if (predictor_) predictor_->observe(pkt, AxisPredictor::nowNs());
+}
+
+void ControllerStateTable::applyEvent(const xbox_udp::InputEventPacket& pkt) {
+    if (pkt.type == 0x01) {  // EV_KEY
+        if (pkt.code >= KEY_COUNT) return;
+        DeviceState& state = deviceState(pkt.device_id);
+        state.buttons[pkt.code] = (pkt.value != 0);
+        state.reported_keys.set(pkt.code);
+        ++state.events;
+    } else if (pkt.type == 0x03) {  // EV_ABS
+        if (pkt.code >= AXIS_COUNT) return;
+        DeviceState& state = deviceState(pkt.device_id);
+        state.axes[pkt.code] = pkt.value;
+        state.normalized[pkt.code] = pkt.normalized;
+        state.reported_axes.set(pkt.code);
+        state.predicted.reset(pkt.code);
+        if (dpad_axis_bits_[pkt.code].any()) {
+            applyDpad(state, pkt.code, pkt.value);
+        }
+        ++state.events;
+    }
+}
+
+void ControllerStateTable::apply(const xbox_udp::FramePacket& frame) {
+    const uint64_t now_ns = predictor_ ? AxisPredictor::nowNs() : 0;
+    for (uint8_t i = 0; i < frame.header.count; ++i) {
+        const xbox_udp::FrameEntry& entry = frame.entries[i];
+        const xbox_udp::InputEventPacket pkt = xbox_udp::frameEntryToEvent(frame.header, entry);
+        applyEvent(pkt);
+        if (predictor_) predictor_->observe(pkt, now_ns, (entry.flags & xbox_udp::ENTRY_NORMALIZED) != 0);
+    }
+}
+
+void ControllerStateTable::apply(const xbox_udp::StatePacket& state) {
+    xbox_udp::forEachStateEvent(state, [this, &state](const xbox_udp::InputEventPacket& pkt) {
+        applyEvent(pkt);
+        if (predictor_ && pkt.type == 0x03) {  // EV_ABS
+            predictor_->reset(pkt, ((state.normalized_mask >> pkt.code) & 1u) != 0);
+        }
+    });
+}
+
+size_t ControllerStateTable::predict(uint64_t now_ns) {
+    if (!predictor_) return 0;
+    size_t changed = 0;
+    std::array<int32_t, AXIS_COUNT> values;
+    std::array<double, AXIS_COUNT> normalized;
+    for (uint8_t device_id : active_) {
+        uint64_t mask = predictor_->predict(device_id, now_ns, values.data(), normalized.data());
+        DeviceState& state = *devices_[device_id];
+        while (mask) {
+            const unsigned code = static_cast<unsigned>(__builtin_ctzll(mask));
+            mask &= mask - 1;
+            if (state.predicted[code] && state.axes[code] == values[code] &&
+                state.normalized[code] == normalized[code]) {
+                continue;
+            }
+            state.axes[code] = values[code];
+            state.normalized[code] = normalized[code];
+            state.predicted.set(code);
+            ++changed;
+        }
+    }
+    return changed;
+}
+
+void ControllerStateTable::applyDpad(DeviceState& state, unsigned code, int32_t value) const {
+    // The button for this value is pressed and the others on the axis released;
+    // centering (0) releases them all. Values without a button change nothing.
+    const DpadEntry* match = nullptr;
+    for (uint8_t i = dpad_begin_[code]; i < dpad_begin_[code + 1]; ++i) {
+        if (dpad_entries_[i].value == value) {
+            match = &dpad_entries_[i];
+            break;
+        }
+    }
+    if (!match && value != 0) return;
+    state.dpad &= ~dpad_axis_bits_[code];
+    if (match) state.dpad.set(match->index);
+}
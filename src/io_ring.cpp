@@ -0,0 +1,318 @@
+/*
+ * io_uring Event Loop Support Implementation
+ */
+
+#include "io_ring.hpp"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+}
+
+}  // namespace
+
+IoRing::IoRing(unsigned entries) {
+    // Completions are only needed when we wait for them: with DEFER_TASKRUN the
+    // kernel runs their work in our io_uring_enter() instead of interrupting us
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    fd_ = io_uring_setup(entries, &params);
+    if (fd_ < 0 && errno == EINVAL) {
+        std::memset(&params, 0, sizeof(params));  // Kernel before 6.1
+        fd_ = io_uring_setup(entries, &params);
+    }
+    if (fd_ < 0) {
+        std::cerr << "io_uring_setup: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    features_ = params.features;
+    // EXT_ARG and NODROP arrived in 5.11, CQE_SKIP (IOSQE_CQE_SKIP_SUCCESS, used by
+    // pollRead()) in 5.17. On older kernels every linked poll would fail at once.
+    if (!(features_ & IORING_FEAT_EXT_ARG) || !(features_ & IORING_FEAT_NODROP) ||
+        !(features_ & IORING_FEAT_CQE_SKIP)) {
+        std::cerr << "io_uring: kernel too old (needs 5.17)" << std::endl;
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        std::cerr << "mmap io_uring SQ ring: " << std::strerror(errno) << std::endl;
+        unmap();
+        return;
+    }
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            std::cerr << "mmap io_uring CQ ring: " << std::strerror(errno) << std::endl;
+            unmap();
+            return;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        std::cerr << "mmap io_uring SQEs: " << std::strerror(errno) << std::endl;
+        unmap();
+        return;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    // SQE i always sits in array slot i: SQEs are submitted in the order handed out
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) array[i] = i;
+    sqe_head_ = sqe_tail_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    if (!probeMultishotPoll()) {
+        std::cerr << "io_uring: multishot poll unsupported" << std::endl;
+        unmap();
+        return;
+    }
+    stats_ = Stats();
+}
+
+bool IoRing::probeMultishotPoll() {
+    // Arm a multishot poll on a readable eventfd: a kernel that supports it
+    // completes it with IORING_CQE_F_MORE set, an older one with -EINVAL
+    int efd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) return false;
+    const uint64_t PROBE = POLL_LINK >> 1;
+    bool armed = false;
+    bool ok = false;
+    if (pollMultishot(efd, PROBE) && submit(1, 1000)) {
+        forEachCompletion([&](const struct io_uring_cqe& cqe) {
+            if (cqe.user_data != PROBE || armed) return;
+            ok = cqe.res >= 0 && (cqe.flags & IORING_CQE_F_MORE);
+            armed = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        });
+    }
+    if (armed) {
+        // Disarm it, and reap its last CQE and the removal's so that none
+        // reaches the event loop
+        struct io_uring_sqe* sqe = getSqe();
+        bool removed = false;
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->addr = PROBE;
+            sqe->user_data = PROBE | 1;
+        }
+        for (int tries = 0; sqe && (armed || !removed) && tries < 10; ++tries) {
+            if (!submit(1, 100)) break;
+            forEachCompletion([&](const struct io_uring_cqe& cqe) {
+                if (cqe.user_data == PROBE && !(cqe.flags & IORING_CQE_F_MORE)) armed = false;
+                if (cqe.user_data == (PROBE | 1)) removed = true;
+            });
+        }
+        ok = ok && !armed && removed;
+    }
+    close(efd);
+    return ok;
+}
+
+IoRing::~IoRing() {
+    unmap();
+}
+
+void IoRing::unmap() {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+}
+
+struct io_uring_sqe* IoRing::getSqe() {
+    if (fd_ < 0) return nullptr;
+    if (sqe_tail_ - sqe_head_ >= sq_entries_) {
+        submit(0, 0);
+        if (sqe_tail_ - sqe_head_ >= sq_entries_) return nullptr;
+    }
+    struct io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    ++sqe_tail_;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool IoRing::reserve(unsigned n) {
+    if (fd_ < 0 || n > sq_entries_) return false;
+    if (sq_entries_ - (sqe_tail_ - sqe_head_) < n) {
+        submit(0, 0);
+    }
+    return sq_entries_ - (sqe_tail_ - sqe_head_) >= n;
+}
+
+bool IoRing::submit(unsigned wait_nr, int timeout_ms) {
+    if (fd_ < 0) return false;
+    const unsigned to_submit = sqe_tail_ - sqe_head_;
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+    // GETEVENTS even without waiting: it runs deferred completion work
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    const void* argp = nullptr;
+    size_t argsz = 0;
+    if (wait_nr > 0 && timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000LL;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+
+    const int r = io_uring_enter(fd_, to_submit, wait_nr, flags, argp, argsz);
+    ++stats_.enters;
+    if (r < 0) {
+        if (errno == ETIME || errno == EINTR || errno == EBUSY) return true;
+        std::cerr << "io_uring_enter: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    sqe_head_ += static_cast<unsigned>(r);
+    stats_.submitted += static_cast<uint64_t>(r);
+    return true;
+}
+
+bool IoRing::pollRead(int fd, void* buf, size_t len, uint64_t user_data) {
+    if (!reserve(2)) return false;
+    struct io_uring_sqe* poll = getSqe();
+    struct io_uring_sqe* read = getSqe();
+    poll->opcode = IORING_OP_POLL_ADD;
+    poll->fd = fd;
+    poll->poll32_events = POLLIN;
+    poll->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    poll->user_data = user_data | POLL_LINK;
+
+    read->opcode = IORING_OP_READ;
+    read->fd = fd;
+    read->addr = reinterpret_cast<uint64_t>(buf);
+    read->len = static_cast<uint32_t>(len);
+    read->off = static_cast<uint64_t>(-1);  // Current position: not seekable
+    read->user_data = user_data;
+    return true;
+}
+
+bool IoRing::pollMultishot(int fd, uint64_t user_data) {
+    struct io_uring_sqe* sqe = getSqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    return true;
+}
+
+IoRingSender::IoRingSender(IoRing& ring, size_t slots) : ring_(ring), slots_(slots) {
+    free_.reserve(slots);
+    for (size_t i = slots; i-- > 0;) free_.push_back(static_cast<uint32_t>(i));
+}
+
+int IoRingSender::send(int sock, struct mmsghdr* msgs, unsigned count, int flags) {
+    ring_.reserve(std::min<unsigned>(count, static_cast<unsigned>(free_.size())));
+    unsigned queued = 0;
+    struct io_uring_sqe* prev = nullptr;
+    for (; queued < count; ++queued) {
+        const struct msghdr& msg = msgs[queued].msg_hdr;
+        size_t len = 0;
+        for (size_t i = 0; i < msg.msg_iovlen; ++i) len += msg.msg_iov[i].iov_len;
+        if (len > sizeof(Slot::data) || msg.msg_namelen > sizeof(Slot::addr)) {
+            errno = EMSGSIZE;
+            break;
+        }
+        if (free_.empty()) {
+            ++stats_.no_slot;
+            errno = ENOBUFS;
+            break;
+        }
+        struct io_uring_sqe* sqe = ring_.getSqe();
+        if (!sqe) {
+            errno = EBUSY;
+            break;
+        }
+
+        const uint32_t index = free_.back();
+        free_.pop_back();
+        Slot& slot = slots_[index];
+        size_t offset = 0;
+        for (size_t i = 0; i < msg.msg_iovlen; ++i) {
+            std::memcpy(slot.data.data + offset, msg.msg_iov[i].iov_base, msg.msg_iov[i].iov_len);
+            offset += msg.msg_iov[i].iov_len;
+        }
+        std::memset(&slot.hdr, 0, sizeof(slot.hdr));
+        slot.iov.iov_base = slot.data.data;
+        slot.iov.iov_len = len;
+        slot.hdr.msg_iov = &slot.iov;
+        slot.hdr.msg_iovlen = 1;
+        if (msg.msg_name) {
+            std::memcpy(&slot.addr, msg.msg_name, msg.msg_namelen);
+            slot.hdr.msg_name = &slot.addr;
+            slot.hdr.msg_namelen = msg.msg_namelen;
+        }
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sock;
+        sqe->addr = reinterpret_cast<uint64_t>(&slot.hdr);
+        sqe->len = 1;
+        sqe->msg_flags = static_cast<uint32_t>(flags | MSG_DONTWAIT);
+        sqe->user_data = TAG | index;
+        // Hard link: in order, and a failed send doesn't cancel the rest of the batch
+        if (prev) prev->flags |= IOSQE_IO_HARDLINK;
+        prev = sqe;
+    }
+    return queued > 0 ? static_cast<int>(queued) : -1;
+}
+
+bool IoRingSender::complete(const struct io_uring_cqe& cqe) {
+    if (!(cqe.user_data & TAG)) return false;
+    const uint32_t index = static_cast<uint32_t>(cqe.user_data & ~TAG);
+    if (index >= slots_.size()) return false;
+    if (cqe.res >= 0 && static_cast<size_t>(cqe.res) == slots_[index].iov.iov_len) {
+        ++stats_.datagrams;
+    } else {
+        ++stats_.errors;
+    }
+    free_.push_back(index);
+    return true;
+}
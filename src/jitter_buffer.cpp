@@ -0,0 +1,151 @@
+/*
+ * Jitter Buffer Implementation
+ */
+
+#include "jitter_buffer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+JitterBuffer::JitterBuffer(const Config& config)
+    : config_(config), slots_(std::max<size_t>(config.capacity, 1)) {
+    free_slots_.reserve(slots_.size());
+    for (size_t i = slots_.size(); i > 0; --i) {
+        free_slots_.push_back(static_cast<uint32_t>(i - 1));
+    }
+    heap_.reserve(slots_.size());
+    stats_.delay_us = config_.delay_us;
+}
+
+uint64_t JitterBuffer::nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+JitterBuffer::Stats JitterBuffer::getStats() const {
+    return stats_;
+}
+
+uint8_t JitterBuffer::deviceOf(const Slot& slot) {
+    switch (slot.kind) {
+    case Kind::Event:
+        return reinterpret_cast<const xbox_udp::InputEventPacket*>(slot.buf.data)->device_id;
+    case Kind::Frame:
+        return reinterpret_cast<const xbox_udp::FramePacket*>(slot.buf.data)->header.device_id;
+    case Kind::State:
+        return reinterpret_cast<const xbox_udp::StatePacket*>(slot.buf.data)->device_id;
+    }
+    return 0;
+}
+
+uint64_t JitterBuffer::timestampOf(const Slot& slot) {
+    switch (slot.kind) {
+    case Kind::Event: {
+        const auto* pkt = reinterpret_cast<const xbox_udp::InputEventPacket*>(slot.buf.data);
+        return xbox_udp::toTimestampNs(pkt->sec, pkt->usec);
+    }
+    case Kind::Frame:
+        return reinterpret_cast<const xbox_udp::FramePacket*>(slot.buf.data)->header.timestamp_ns;
+    case Kind::State:
+        return reinterpret_cast<const xbox_udp::StatePacket*>(slot.buf.data)->timestamp_ns;
+    }
+    return 0;
+}
+
+void JitterBuffer::updateWindow(WindowedExtreme& w, int64_t value, uint64_t now_ns, bool is_min) const {
+    const uint64_t half_window_ns = static_cast<uint64_t>(config_.window_ms) * 500000ull;
+    if (!w.started) {
+        w.started = true;
+        w.current = w.previous = value;
+        w.bucket_start_ns = now_ns;
+    } else if (now_ns - w.bucket_start_ns >= half_window_ns) {
+        w.previous = w.current;
+        w.current = value;
+        w.bucket_start_ns = now_ns;
+    } else {
+        w.current = is_min ? std::min(w.current, value) : std::max(w.current, value);
+    }
+}
+
+int64_t JitterBuffer::windowValue(const WindowedExtreme& w, bool is_min) {
+    return is_min ? std::min(w.current, w.previous) : std::max(w.current, w.previous);
+}
+
+void JitterBuffer::insert(Kind kind, uint8_t device_id, uint64_t timestamp_ns, const void* data,
+                          size_t len, uint64_t now_ns) {
+    ++stats_.packets;
+    Device& device = devices_[device_id];
+    if (device.released_any && timestamp_ns < device.last_released_ts) {
+        ++stats_.late_dropped;
+        return;
+    }
+
+    // Transit = clock offset + network delay; the windowed minimum is the offset
+    const int64_t transit = static_cast<int64_t>(now_ns - timestamp_ns);
+    updateWindow(device.offset, transit, now_ns, true);
+    const int64_t offset = windowValue(device.offset, true);
+    updateWindow(device.jitter, transit - offset, now_ns, false);
+    const int64_t jitter = windowValue(device.jitter, false);
+
+    int64_t delay = static_cast<int64_t>(config_.delay_us) * 1000;
+    if (config_.adaptive) {
+        delay = std::max(delay, std::min(jitter, static_cast<int64_t>(config_.max_delay_us) * 1000));
+    }
+    stats_.delay_us = static_cast<uint32_t>(delay / 1000);
+    stats_.jitter_us = static_cast<uint32_t>(jitter / 1000);
+
+    uint64_t playout_ns = timestamp_ns + static_cast<uint64_t>(offset + delay);
+    if (timestamp_ns >= device.last_pushed_ts) {
+        // In order: a shrinking offset or delay must not overtake packets already queued
+        playout_ns = std::max(playout_ns, device.last_playout_ns);
+        device.last_playout_ns = playout_ns;
+        device.last_pushed_ts = timestamp_ns;
+    }
+    if (playout_ns < now_ns) {
+        ++stats_.late;
+        playout_ns = now_ns;
+    }
+
+    enqueue(kind, data, len, playout_ns, now_ns);
+}
+
+void JitterBuffer::insertState(const xbox_udp::StatePacket& state, uint64_t now_ns) {
+    ++stats_.packets;
+    Device& device = devices_[state.device_id];
+    if (device.released_any && state.timestamp_ns < device.last_released_ts) {
+        ++stats_.late_dropped;
+        return;
+    }
+    // Right behind the newest packet queued, so the smoothed queue plays out as
+    // planned; the state's timestamp says nothing about network delay
+    enqueue(Kind::State, &state, sizeof(state), std::max(device.last_playout_ns, now_ns), now_ns);
+}
+
+void JitterBuffer::enqueue(Kind kind, const void* data, size_t len, uint64_t playout_ns, uint64_t now_ns) {
+    const uint32_t index = free_slots_.back();
+    free_slots_.pop_back();
+    Slot& slot = slots_[index];
+    slot.kind = kind;
+    slot.arrival_ns = now_ns;
+    std::memcpy(slot.buf.data, data, std::min(len, sizeof(slot.buf.data)));
+
+    heap_.push_back({playout_ns, order_++, index});
+    std::push_heap(heap_.begin(), heap_.end(), later);
+}
+
+uint32_t JitterBuffer::popFront(uint64_t now_ns) {
+    std::pop_heap(heap_.begin(), heap_.end(), later);
+    const uint32_t index = heap_.back().slot;
+    heap_.pop_back();
+
+    const Slot& slot = slots_[index];
+    Device& device = devices_[deviceOf(slot)];
+    device.last_released_ts = std::max(device.last_released_ts, timestampOf(slot));
+    device.released_any = true;
+
+    const uint64_t added = now_ns > slot.arrival_ns ? now_ns - slot.arrival_ns : 0;
+    ++stats_.released;
+    stats_.added_latency_ns += added;
+    stats_.max_added_latency_ns = std::max(stats_.max_added_latency_ns, added);
+    return index;
+}
@@ -10,6 +10,11 @@
 
 #include "controller_base.hpp"
 #include "controller_config.hpp"
+#ifdef XBOX_HAVE_IO_URING
+#include "io_ring.hpp"
+#endif
+#include "shm_transport.hpp"
+#include "socket_util.hpp"
 #include "udp_publisher.hpp"
 #include "udp_receiver.hpp"
 #include "xbox_udp_protocol.hpp"
@@ -19,10 +24,14 @@
 #include <linux/input-event-codes.h>
 
 #include <algorithm>
+#include <array>
+#include <arpa/inet.h>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <dirent.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <iostream>
 #include <poll.h>
 #include <string>
@@ -58,6 +67,7 @@ struct ControllerInfo {
     ControllerHandle handle;
     std::unique_ptr<ControllerBase> controller;
     uint8_t device_id;
+    std::chrono::steady_clock::time_point next_keyframe;  // Epoch: send one right away
 };
 
 std::vector<ControllerInfo> scan_controllers(const std::unordered_set<std::string>& exclude_paths,
@@ -141,72 +151,104 @@ std::vector<ControllerInfo> scan_controllers(const std::unordered_set<std::strin
     return out;
 }
 
-}  // namespace
+// What both event loops share: the open controllers and where their reports go
+struct Publishing {
+    UDPPublisher& publisher;
+    ShmPublisher* shm;
+    int keyframe_ms;
+    std::vector<ControllerInfo> controllers;
+    std::unordered_set<std::string> open_paths;
+    time_t last_rescan = time(nullptr);
+    uint8_t next_device_id = 0;
 
-int main(int argc, char* argv[]) {
-    const char* dest = "127.0.0.1";
-    unsigned short port = xbox_udp::DEFAULT_PORT;
-    if (argc >= 2) dest = argv[1];
-    if (argc >= 3) port = static_cast<unsigned short>(std::stoul(argv[2]));
+    Publishing(UDPPublisher& publisher, ShmPublisher* shm, int keyframe_ms)
+        : publisher(publisher), shm(shm), keyframe_ms(keyframe_ms) {}
 
-    // Create UDP publisher
-    UDPPublisher publisher(dest, port);
-    if (!publisher.isConnected()) {
-        std::cerr << "Failed to create UDP publisher" << std::endl;
-        return 1;
+    // Open new controllers every RESCAN_INTERVAL_SEC (appended to `controllers`)
+    void rescanIfDue() {
+        time_t now = time(nullptr);
+        if (now - last_rescan < static_cast<time_t>(RESCAN_INTERVAL_SEC)) return;
+        last_rescan = now;
+        auto found = scan_controllers(open_paths, next_device_id);
+        for (auto& info : found) {
+            if (open_paths.count(info.handle.path)) continue;
+            open_paths.insert(info.handle.path);
+            if (shm) shm->publishState(info.controller->getState());
+            controllers.push_back(std::move(info));
+        }
     }
 
-    // Create UDP receiver for vibration commands
-    UDPReceiver receiver(port, port + 1);
-    if (!receiver.bind()) {
-        std::cerr << "Failed to bind UDP receiver" << std::endl;
-        return 1;
-    }
+    void sendDue() {
+        // Periodic full-state keyframes; frames in between carry only the deltas
+        if (keyframe_ms > 0) {
+            auto now_tp = std::chrono::steady_clock::now();
+            bool queued = false;
+            for (auto& info : controllers) {
+                if (now_tp < info.next_keyframe) continue;
+                info.next_keyframe = now_tp + std::chrono::milliseconds(keyframe_ms);
+                publisher.queueState(info.controller->getState());
+                queued = true;
+            }
+            if (queued) publisher.flush();
+        }
 
-    std::cout << "Joystick Controller Manager" << std::endl;
-    std::cout << "  Publishing events to: " << dest << ":" << port << std::endl;
-    std::cout << "  Listening for vibration on: 0.0.0.0:" << (port + 1) << std::endl;
+        // Rate-limited subscribers whose interval has passed get the latest states
+        if (publisher.subscriberTimeoutMs() == 0) {
+            publisher.flush();
+        }
+    }
 
-    std::vector<ControllerInfo> controllers;
-    std::unordered_set<std::string> open_paths;
-    time_t last_rescan = time(nullptr);
-    uint8_t next_device_id = 0;
+    // How long the loop may wait before sendDue() has something to do
+    int timeoutMs() const {
+        int timeout_ms = keyframe_ms > 0 ? std::min(keyframe_ms, 2000) : 2000;
+        const int subscriber_ms = publisher.subscriberTimeoutMs();
+        if (subscriber_ms >= 0) {
+            timeout_ms = std::min(timeout_ms, subscriber_ms);
+        }
+        return timeout_ms;
+    }
 
-    // Set up vibration callback
-    receiver.setVibrationCallback([&controllers](const xbox_udp::VibrationPacket& pkt) {
-        if (pkt.device_id < controllers.size()) {
-            ControllerInfo& info = controllers[pkt.device_id];
-            if (pkt.left_motor == 0 && pkt.right_motor == 0) {
-                info.controller->stopVibration();
-                std::cout << "Stopped vibration on controller " << (int)pkt.device_id << std::endl;
-            } else {
-                if (info.controller->sendVibration(pkt.left_motor, pkt.right_motor)) {
-                    std::cout << "Vibration on controller " << (int)pkt.device_id 
-                              << ": L=" << pkt.left_motor << " R=" << pkt.right_motor << std::endl;
-                } else {
-                    std::cerr << "Failed to send vibration to controller " << (int)pkt.device_id << std::endl;
+    void handleEvent(ControllerInfo& info, const struct input_event& ev) {
+        if (ev.type == EV_SYN) {
+            // End of report: submit all of its events (or its frame) with one sendmmsg()
+            if (ev.code == SYN_REPORT) {
+                if (publisher.subscriberCount() > 0) {
+                    publisher.publishState(info.controller->getState());
+                }
+                publisher.flush();
+                if (shm) {
+                    shm->publishState(info.controller->getState());
+                    shm->flush();
                 }
             }
+            return;
         }
-    });
 
-    for (;;) {
-        time_t now = time(nullptr);
-        if (now - last_rescan >= static_cast<time_t>(RESCAN_INTERVAL_SEC)) {
-            last_rescan = now;
-            auto found = scan_controllers(open_paths, next_device_id);
-            for (auto& info : found) {
-                if (open_paths.count(info.handle.path)) continue;
-                open_paths.insert(info.handle.path);
-                controllers.push_back(std::move(info));
-            }
+        xbox_udp::InputEventPacket pkt;
+        if (info.controller->processEvent(ev, pkt)) {
+            publisher.queueEvent(pkt);
+            if (shm) shm->queueEvent(pkt);
         }
+    }
+
+    // Don't hold back a partial report if the read stopped mid-report
+    void flushPartial() {
+        publisher.flush();
+        if (shm) shm->flush();
+    }
+};
+
+void run_poll_loop(Publishing& app, UDPReceiver& receiver) {
+    for (;;) {
+        app.rescanIfDue();
 
         // Poll for vibration commands
         receiver.poll(0);
 
+        app.sendDue();
+
         std::vector<pollfd> pfds;
-        for (const auto& info : controllers) {
+        for (const auto& info : app.controllers) {
             if (info.handle.fd >= 0) {
                 pollfd p{};
                 p.fd = info.handle.fd;
@@ -220,7 +262,7 @@ int main(int argc, char* argv[]) {
             continue;
         }
 
-        int r = poll(pfds.data(), pfds.size(), 2000);
+        int r = poll(pfds.data(), pfds.size(), app.timeoutMs());
         if (r < 0) {
             if (errno == EINTR) continue;
             std::cerr << "poll: " << std::strerror(errno) << std::endl;
@@ -230,29 +272,430 @@ int main(int argc, char* argv[]) {
 
         for (size_t i = 0; i < pfds.size(); ++i) {
             if (!(pfds[i].revents & POLLIN)) continue;
-            if (i >= controllers.size()) continue;
+            if (i >= app.controllers.size()) continue;
             
-            ControllerInfo& info = controllers[i];
+            ControllerInfo& info = app.controllers[i];
             if (!info.handle.dev) continue;
 
             struct input_event ev;
-            int n_ev = 0;
             while (libevdev_next_event(info.handle.dev, LIBEVDEV_READ_FLAG_NORMAL, &ev) == 0) {
-                if (ev.type == EV_SYN) continue;
-                
-                xbox_udp::InputEventPacket pkt;
-                if (info.controller->processEvent(ev, pkt)) {
-                    publisher.sendEvent(pkt);
-                    ++n_ev;
+                app.handleEvent(info, ev);
+            }
+            app.flushPartial();
+        }
+
+        app.open_paths.clear();
+        for (const auto& info : app.controllers) {
+            app.open_paths.insert(info.handle.path);
+        }
+    }
+}
+
+#ifdef XBOX_HAVE_IO_URING
+// One io_uring_enter() per wakeup: it submits the sends of the reports just
+// processed and the re-armed reads, then waits for the next completion. Each
+// controller has a POLL_ADD linked to a READ of raw input_events (libevdev's
+// own read() per call is bypassed), the control socket a multishot poll.
+// Returns false, before doing anything, if io_uring is unavailable.
+bool run_io_uring_loop(Publishing& app, UDPReceiver& receiver) {
+    IoRing ring(256);
+    if (!ring.isOpen()) return false;
+    IoRingSender sender(ring);
+    app.publisher.setSender([&sender](int sock, struct mmsghdr* msgs, unsigned count, int flags) {
+        return sender.send(sock, msgs, count, flags);
+    });
+
+    // user_data: controller index, or CONTROL for the control socket's poll
+    constexpr uint64_t CONTROL = 1ull << 48;
+    struct DeviceRead {
+        std::array<struct input_event, 64> events;
+    };
+    std::vector<std::unique_ptr<DeviceRead>> reads;
+    std::vector<struct input_event> resync;
+    auto arm = [&](size_t index) {
+        ring.pollRead(app.controllers[index].handle.fd, reads[index]->events.data(),
+                      sizeof(reads[index]->events), index);
+    };
+    ring.pollMultishot(receiver.controlSocket(), CONTROL);
+
+    for (;;) {
+        app.rescanIfDue();
+        while (reads.size() < app.controllers.size()) {
+            reads.emplace_back(new DeviceRead());
+            arm(reads.size() - 1);
+        }
+
+        app.sendDue();
+
+        if (!ring.submit(1 + sender.inFlight(), app.timeoutMs())) {
+            break;
+        }
+
+        bool control_ready = false;
+        bool control_armed = true;
+        ring.forEachCompletion([&](const struct io_uring_cqe& cqe) {
+            if (sender.complete(cqe)) return;
+            if (cqe.user_data == CONTROL) {
+                control_ready = true;
+                control_armed = (cqe.flags & IORING_CQE_F_MORE) != 0;
+                return;
+            }
+            if (cqe.user_data & IoRing::POLL_LINK) return;  // Failed poll: its READ says -ECANCELED
+
+            const size_t index = static_cast<size_t>(cqe.user_data);
+            ControllerInfo& info = app.controllers[index];
+            if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED) {
+                // Unplugged: stop reading it
+                std::cerr << "read " << info.handle.path << ": " << std::strerror(-cqe.res) << std::endl;
+                return;
+            }
+            const DeviceRead& read = *reads[index];
+            const size_t count = cqe.res > 0 ? static_cast<size_t>(cqe.res) / sizeof(struct input_event) : 0;
+            for (size_t i = 0; i < count; ++i) {
+                const struct input_event& ev = read.events[i];
+                if (ev.type == EV_SYN && ev.code == SYN_DROPPED) {
+                    // The kernel dropped events. libevdev never saw our reads, so
+                    // its sync delta would be against stale values: compare the
+                    // kernel's current values with the state we published instead,
+                    // send the differences as one report, and skip the rest of
+                    // this read, which that state already covers
+                    resync.clear();
+                    info.controller->resyncEvents(resync);
+                    for (const auto& sync : resync) app.handleEvent(info, sync);
+                    struct input_event report;
+                    std::memset(&report, 0, sizeof(report));
+                    report.type = EV_SYN;
+                    report.code = SYN_REPORT;
+                    app.handleEvent(info, report);
+                    break;
+                }
+                app.handleEvent(info, ev);
+            }
+            app.flushPartial();
+            arm(index);
+        });
+
+        if (control_ready) receiver.drainControlSocket();
+        if (!control_armed) ring.pollMultishot(receiver.controlSocket(), CONTROL);
+    }
+    app.publisher.setSender(nullptr);
+    return true;
+}
+#endif
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] [dest] [port]" << std::endl;
+    std::cerr << "  dest      Destination address, IPv4 multicast group or unix:/path for a" << std::endl;
+    std::cerr << "            Unix datagram socket on this host (default: 127.0.0.1)" << std::endl;
+    std::cerr << "  port      Destination port (default: " << xbox_udp::DEFAULT_PORT
+              << "); vibration commands are received on port + 1" << std::endl;
+    std::cerr << "  --dest HOST[:PORT] | unix:/path" << std::endl;
+    std::cerr << "            Also publish to HOST (PORT defaults to port); repeatable. Every" << std::endl;
+    std::cerr << "            packet is encoded once and sent to all destinations in one batch" << std::endl;
+    std::cerr << "  --format event|compact|frame" << std::endl;
+    std::cerr << "            event:   one packet per input event (default)" << std::endl;
+    std::cerr << "            compact: one aligned v2 packet per input event" << std::endl;
+    std::cerr << "            frame:   one aligned v2 packet per device report (SYN_REPORT)" << std::endl;
+    std::cerr << "  --history N" << std::endl;
+    std::cerr << "            compact/frame: repeat each device's last N button edges (max "
+              << xbox_udp::MAX_FRAME_HISTORY << ") in every packet, so a single lost" << std::endl;
+    std::cerr << "            packet never loses a button press or release (default: 0)" << std::endl;
+    std::cerr << "  --ttl N   Multicast TTL (default: 1, local subnet)" << std::endl;
+    std::cerr << "  --no-loop" << std::endl;
+    std::cerr << "            Don't loop multicast back to receivers on this host" << std::endl;
+    std::cerr << "  --interface IF" << std::endl;
+    std::cerr << "            Multicast outgoing interface (address or name)" << std::endl;
+    std::cerr << "  --shm NAME" << std::endl;
+    std::cerr << "            Also publish frames and controller states to the shared-memory" << std::endl;
+    std::cerr << "            segment /NAME for consumers on this host (no UDP stack)" << std::endl;
+    std::cerr << "  --io-uring" << std::endl;
+    std::cerr << "            Event loop on io_uring: one syscall per wakeup for device reads," << std::endl;
+    std::cerr << "            sends and vibration commands (falls back to poll())" << std::endl;
+    std::cerr << "  --allow-subscribers" << std::endl;
+    std::cerr << "            Accept subscriber registrations on the vibration port. Source" << std::endl;
+    std::cerr << "            addresses can be forged, so only enable this on trusted networks" << std::endl;
+    std::cerr << "            (default: off, subscribe packets are ignored)" << std::endl;
+    std::cerr << "  --gso     Hand each burst of equal-sized packets (keyframes of all devices," << std::endl;
+    std::cerr << "            events of a report) to the kernel as one UDP_SEGMENT message" << std::endl;
+    std::cerr << "            (IPv4, not with --io-uring)" << std::endl;
+    std::cerr << "  --socket-profile FILE" << std::endl;
+    std::cerr << "            Socket options from the socket: section of a YAML file" << std::endl;
+    std::cerr << "            (e.g. config/socket_profile.yaml); the flags below override it" << std::endl;
+    std::cerr << "  --dscp CODE" << std::endl;
+    std::cerr << "            Mark sent packets with DSCP CODE: EF, AF11-AF43, CS0-CS7 or 0-63" << std::endl;
+    std::cerr << "  --priority N, --busy-poll US, --sndbuf BYTES, --rcvbuf BYTES, --rcvlowat BYTES" << std::endl;
+    std::cerr << "            SO_PRIORITY, SO_BUSY_POLL and buffer sizes of the publisher and" << std::endl;
+    std::cerr << "            vibration sockets (default: kernel defaults); SO_RCVLOWAT has no" << std::endl;
+    std::cerr << "            effect on datagram sockets and is ignored" << std::endl;
+    std::cerr << "  --keyframe-ms N" << std::endl;
+    std::cerr << "            Also send each controller's full state every N ms, so late or" << std::endl;
+    std::cerr << "            lossy receivers recover pressed buttons (default: 0 = off)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const char* dest = "127.0.0.1";
+    unsigned short port = xbox_udp::DEFAULT_PORT;
+    UDPPublisher::Format format = UDPPublisher::Format::Event;
+    int keyframe_ms = 0;
+    unsigned long history = 0;
+    UDPPublisher::MulticastOptions multicast;
+    std::vector<std::string> extra_dests;
+    std::string shm_name;
+    bool use_io_uring = false;
+    bool allow_subscribers = false;
+    bool segmentation = false;
+    std::string socket_profile;
+    std::vector<std::pair<std::string, std::string>> socket_flags;
+
+    static const struct option long_options[] = {
+        {"dest", required_argument, nullptr, 'd'},
+        {"format", required_argument, nullptr, 'f'},
+        {"keyframe-ms", required_argument, nullptr, 'k'},
+        {"history", required_argument, nullptr, 'H'},
+        {"ttl", required_argument, nullptr, 't'},
+        {"no-loop", no_argument, nullptr, 'L'},
+        {"interface", required_argument, nullptr, 'i'},
+        {"shm", required_argument, nullptr, 's'},
+        {"io-uring", no_argument, nullptr, 'u'},
+        {"allow-subscribers", no_argument, nullptr, 'A'},
+        {"gso", no_argument, nullptr, 'g'},
+        {"socket-profile", required_argument, nullptr, 'P'},
+        {"busy-poll", required_argument, nullptr, 'O'},
+        {"priority", required_argument, nullptr, 'O'},
+        {"dscp", required_argument, nullptr, 'O'},
+        {"sndbuf", required_argument, nullptr, 'O'},
+        {"rcvbuf", required_argument, nullptr, 'O'},
+        {"rcvlowat", required_argument, nullptr, 'O'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "h", long_options, &option_index)) != -1) {
+        switch (opt) {
+        case 'd':
+            extra_dests.push_back(optarg);
+            break;
+        case 'f':
+            if (std::strcmp(optarg, "event") == 0) {
+                format = UDPPublisher::Format::Event;
+            } else if (std::strcmp(optarg, "compact") == 0) {
+                format = UDPPublisher::Format::Compact;
+            } else if (std::strcmp(optarg, "frame") == 0) {
+                format = UDPPublisher::Format::Frame;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'k':
+            keyframe_ms = std::stoi(optarg);
+            if (keyframe_ms < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'H':
+            history = std::stoul(optarg);
+            if (history > xbox_udp::MAX_FRAME_HISTORY) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 't':
+            multicast.ttl = std::stoi(optarg);
+            if (multicast.ttl < 0 || multicast.ttl > 255) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'L':
+            multicast.loopback = false;
+            break;
+        case 'i':
+            multicast.interface = optarg;
+            break;
+        case 's':
+            shm_name = optarg;
+            break;
+        case 'u':
+            use_io_uring = true;
+            break;
+        case 'A':
+            allow_subscribers = true;
+            break;
+        case 'g':
+            segmentation = true;
+            break;
+        case 'P':
+            socket_profile = optarg;
+            break;
+        case 'O':
+            // Applied after --socket-profile, whatever the order
+            socket_flags.emplace_back(long_options[option_index].name, optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) dest = argv[optind++];
+    if (optind < argc) port = static_cast<unsigned short>(std::stoul(argv[optind++]));
+
+    socket_util::SocketOptions socket_options;
+    if (!socket_profile.empty() && !socket_util::loadSocketOptions(socket_profile, socket_options)) {
+        return 1;
+    }
+    for (const auto& flag : socket_flags) {
+        if (!socket_util::setSocketOption(socket_options, flag.first, flag.second)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Create UDP publisher
+    UDPPublisher publisher(dest, port, multicast);
+    if (!publisher.isConnected()) {
+        std::cerr << "Failed to create UDP publisher" << std::endl;
+        return 1;
+    }
+    for (const auto& extra : extra_dests) {
+        const size_t colon = socket_util::isUnixEndpoint(extra) ? std::string::npos : extra.find(':');
+        const unsigned short extra_port = colon == std::string::npos ? port :
+            static_cast<unsigned short>(std::stoul(extra.substr(colon + 1)));
+        if (!publisher.addDestination(extra.substr(0, colon), extra_port)) {
+            std::cerr << "Invalid destination: " << extra << std::endl;
+            return 1;
+        }
+    }
+    publisher.setFormat(format);
+    publisher.setHistoryDepth(history);
+    if (!socket_options.empty()) {
+        publisher.setSocketOptions(socket_options);
+    }
+    if (segmentation && !publisher.setSegmentation(true)) {
+        std::cerr << "UDP segmentation offload unavailable, sending datagrams one by one" << std::endl;
+    }
+
+    // Same-host consumers can read the shared-memory ring instead
+    std::unique_ptr<ShmPublisher> shm;
+    if (!shm_name.empty()) {
+        shm.reset(new ShmPublisher(shm_name));
+        if (!shm->isOpen()) {
+            std::cerr << "Failed to create shared-memory segment " << shm_name << std::endl;
+            return 1;
+        }
+    }
+
+    // Create UDP receiver for vibration commands (the event port belongs to consumers)
+    UDPReceiver receiver(0, port + 1);
+    receiver.setSocketOptions(socket_options);
+    if (!receiver.bind()) {
+        std::cerr << "Failed to bind UDP receiver" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Joystick Controller Manager" << std::endl;
+    std::cout << "  Publishing events to: " << dest
+              << (publisher.isUnix() ? "" : ":" + std::to_string(port))
+              << (format == UDPPublisher::Format::Frame ? " (frames)" :
+                  format == UDPPublisher::Format::Compact ? " (compact events)" : " (events)")
+              << std::endl;
+    for (const auto& extra : extra_dests) {
+        std::cout << "                   and: " << extra << std::endl;
+    }
+    if (publisher.isMulticast()) {
+        std::cout << "  Multicast: ttl " << multicast.ttl << ", loopback "
+                  << (multicast.loopback ? "on" : "off")
+                  << (multicast.interface.empty() ? "" : ", interface " + multicast.interface)
+                  << std::endl;
+    }
+    if (history > 0 && format != UDPPublisher::Format::Event) {
+        std::cout << "  Button edge history: " << history << " per packet" << std::endl;
+    }
+    if (keyframe_ms > 0) {
+        std::cout << "  Keyframes every " << keyframe_ms << " ms" << std::endl;
+    }
+    if (shm) {
+        std::cout << "  Shared memory: " << shm->getName() << std::endl;
+    }
+    if (use_io_uring) {
+        std::cout << "  Event loop: io_uring" << std::endl;
+    }
+    if (publisher.getSegmentation()) {
+        std::cout << "  UDP segmentation offload: on" << std::endl;
+    }
+    std::cout << "  Listening for vibration, subscriptions and state requests on: 0.0.0.0:" << (port + 1) << std::endl;
+    std::cout << "  Publisher socket: " << publisher.describeSocketOptions() << std::endl;
+    std::cout << "  Vibration socket: " << receiver.describeSocketOptions() << std::endl;
+
+    Publishing app(publisher, shm.get(), keyframe_ms);
+    std::vector<ControllerInfo>& controllers = app.controllers;
+
+    // Set up vibration callback
+    receiver.setVibrationCallback([&controllers](const xbox_udp::VibrationPacket& pkt) {
+        if (pkt.device_id < controllers.size()) {
+            ControllerInfo& info = controllers[pkt.device_id];
+            if (pkt.left_motor == 0 && pkt.right_motor == 0) {
+                info.controller->stopVibration();
+                std::cout << "Stopped vibration on controller " << (int)pkt.device_id << std::endl;
+            } else {
+                if (info.controller->sendVibration(pkt.left_motor, pkt.right_motor)) {
+                    std::cout << "Vibration on controller " << (int)pkt.device_id 
+                              << ": L=" << pkt.left_motor << " R=" << pkt.right_motor << std::endl;
+                } else {
+                    std::cerr << "Failed to send vibration to controller " << (int)pkt.device_id << std::endl;
                 }
             }
         }
+    });
+
+    // Receivers registering for the stream (full rate or coalesced states at a max rate).
+    // A forged registration would stream at its spoofed source, so this is opt-in.
+    if (allow_subscribers) {
+        receiver.setSubscribeCallback([&publisher](const xbox_udp::SubscribePacket& pkt,
+                                                   const struct sockaddr_in& from) {
+            const size_t before = publisher.subscriberCount();
+            if (!publisher.handleSubscribe(pkt, from)) return;
+            if (publisher.subscriberCount() != before) {
+                std::cout << "Subscriber " << inet_ntoa(from.sin_addr) << ":" << ntohs(from.sin_port)
+                          << ((pkt.flags & xbox_udp::SUBSCRIBE_CANCEL) ? " left" : " joined");
+                if (!(pkt.flags & xbox_udp::SUBSCRIBE_CANCEL)) {
+                    if (pkt.max_rate_hz) {
+                        std::cout << " (" << pkt.max_rate_hz << " Hz)";
+                    } else {
+                        std::cout << " (full rate)";
+                    }
+                }
+                std::cout << "; " << publisher.subscriberCount() << " subscriber(s)" << std::endl;
+            }
+        });
+    }
 
-        open_paths.clear();
+    // Late joiners asking for the current state: one snapshot per requested device,
+    // from the state each controller keeps (seeded from the device when opened)
+    receiver.setStateRequestCallback([&publisher, &controllers](const xbox_udp::StateRequestPacket& pkt,
+                                                                const struct sockaddr_in& from) {
         for (const auto& info : controllers) {
-            open_paths.insert(info.handle.path);
+            if (pkt.device_id != xbox_udp::STATE_REQUEST_ALL && pkt.device_id != info.device_id) continue;
+            publisher.sendSnapshot(info.controller->getState(), pkt, from);
         }
+    });
+
+#ifdef XBOX_HAVE_IO_URING
+    if (!use_io_uring || !run_io_uring_loop(app, receiver)) {
+        if (use_io_uring) std::cerr << "io_uring unavailable, using poll()" << std::endl;
+        run_poll_loop(app, receiver);
     }
+#else
+    if (use_io_uring) std::cerr << "Built without io_uring, using poll()" << std::endl;
+    run_poll_loop(app, receiver);
+#endif
 
     // Cleanup
     for (auto& info : controllers) {
@@ -0,0 +1,60 @@
+/*
+ * Latency Histogram Implementation
+ */
+
+#include "latency_histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < SUB_COUNT) return static_cast<size_t>(value);
+    // Block k >= 1 holds [2^(SUB_BITS + k - 1), 2^(SUB_BITS + k)) in SUB_COUNT buckets
+    const unsigned exponent = 63u - static_cast<unsigned>(__builtin_clzll(value));
+    const unsigned shift = exponent - SUB_BITS;
+    return static_cast<size_t>(shift + 1) * SUB_COUNT + static_cast<size_t>((value >> shift) - SUB_COUNT);
+}
+
+uint64_t LatencyHistogram::bucketUpper(size_t bucket) {
+    if (bucket < SUB_COUNT) return bucket;
+    const unsigned shift = static_cast<unsigned>(bucket / SUB_COUNT) - 1;
+    const uint64_t lower = static_cast<uint64_t>(SUB_COUNT + bucket % SUB_COUNT) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t value_ns) {
+    if (value_ns < 0) {
+        ++negative_;
+        return;
+    }
+    const uint64_t value = std::min(static_cast<uint64_t>(value_ns), MAX_VALUE);
+    ++counts_[bucketOf(value)];
+    ++count_;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    sum_ += value;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (count_ == 0) return 0;
+    const double clamped = std::max(0.0, std::min(100.0, p));
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * count_)));
+    uint64_t seen = 0;
+    for (size_t bucket = bucketOf(min_); bucket < BUCKETS; ++bucket) {
+        seen += counts_[bucket];
+        if (seen >= rank) return std::min(bucketUpper(bucket), max_);
+    }
+    return max_;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    negative_ += other.negative_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+void LatencyHistogram::reset() {
+    *this = LatencyHistogram();
+}
@@ -0,0 +1,74 @@
+/*
+ * Sequence Tracker Implementation
+ */
+
+#include "sequence_tracker.hpp"
+
+SequenceStats& SequenceStats::operator+=(const SequenceStats& other) {
+    received += other.received;
+    lost += other.lost;
+    duplicates += other.duplicates;
+    reordered += other.reordered;
+    stale += other.stale;
+    resets += other.resets;
+    recovered += other.recovered;
+    return *this;
+}
+
+SequenceTracker::Result SequenceTracker::update(uint32_t seq) {
+    ++stats_.received;
+    
+    if (!started_) {
+        started_ = true;
+        highest_ = seq;
+        window_ = 1;
+        return Result::First;
+    }
+    
+    // Wrap-around safe distance from the newest sequence number seen
+    int32_t delta = static_cast<int32_t>(seq - highest_);
+    
+    if (delta > 0) {
+        uint32_t ahead = static_cast<uint32_t>(delta);
+        stats_.lost += ahead - 1;
+        window_ = (ahead >= WINDOW) ? 1 : ((window_ << ahead) | 1);
+        highest_ = seq;
+        return ahead == 1 ? Result::InOrder : Result::Gap;
+    }
+    
+    uint32_t behind = static_cast<uint32_t>(-static_cast<int64_t>(delta));
+    if (behind == 0) {
+        ++stats_.duplicates;
+        return Result::Duplicate;
+    }
+    if (behind > RESET_THRESHOLD) {
+        ++stats_.resets;
+        highest_ = seq;
+        window_ = 1;
+        return Result::Reset;
+    }
+    if (behind >= WINDOW) {
+        // Can't tell a late first copy from a duplicate here; assume the former
+        if (stats_.lost > 0) --stats_.lost;
+        ++stats_.stale;
+        return Result::Stale;
+    }
+    
+    uint64_t bit = uint64_t(1) << behind;
+    if (window_ & bit) {
+        ++stats_.duplicates;
+        return Result::Duplicate;
+    }
+    window_ |= bit;
+    // It was counted as lost when the gap opened
+    if (stats_.lost > 0) --stats_.lost;
+    ++stats_.reordered;
+    return Result::Reordered;
+}
+
+bool SequenceTracker::wasReceived(uint32_t seq) const {
+    if (!started_) return false;
+    uint32_t behind = highest_ - seq;
+    if (behind >= WINDOW) return false;
+    return (window_ >> behind) & 1u;
+}
@@ -0,0 +1,126 @@
+/*
+ * Sharded Receiver Implementation
+ */
+
+#include "sharded_receiver.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Poll timeout of the workers: bounds how long stop() waits for them
+constexpr int WORKER_POLL_MS = 50;
+
+// CPUs this process may run on, in ascending order
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+}  // namespace
+
+ShardedReceiver::ShardedReceiver(unsigned short event_port, size_t shards)
+    : event_port_(event_port) {
+    for (size_t i = 0; i < std::max<size_t>(shards, 1); ++i) {
+        shards_.emplace_back(new Shard());
+    }
+}
+
+ShardedReceiver::~ShardedReceiver() {
+    stop();
+}
+
+bool ShardedReceiver::start() {
+    if (running_) return true;
+
+    const std::vector<int> cpus = pin_threads_ ? allowed_cpus() : std::vector<int>();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        Shard& shard = *shards_[i];
+        shard.receiver.reset(new UDPReceiver(event_port_, 0));
+        shard.receiver->setReusePort(true);
+        if (setup_) {
+            setup_(i, *shard.receiver);
+        }
+        if (!shard.receiver->bind()) {
+            std::cerr << "ShardedReceiver: failed to bind shard " << i << std::endl;
+            for (auto& other : shards_) other->receiver.reset();
+            return false;
+        }
+        shard.target_cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        shard.cpu.store(-1, std::memory_order_relaxed);
+    }
+
+    running_ = true;
+    for (auto& shard : shards_) {
+        Shard* s = shard.get();
+        s->worker = std::thread([this, s]() { run(*s); });
+    }
+    return true;
+}
+
+void ShardedReceiver::stop() {
+    if (!running_) return;
+    running_ = false;
+    for (auto& shard : shards_) {
+        if (shard->worker.joinable()) {
+            shard->worker.join();
+        }
+        shard->receiver.reset();
+    }
+}
+
+void ShardedReceiver::run(Shard& shard) {
+    // Pin before the first poll so no packet is handled on another CPU
+    if (shard.target_cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard.target_cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            std::cerr << "pthread_setaffinity_np cpu " << shard.target_cpu << ": " << std::strerror(err) << std::endl;
+        } else {
+            shard.cpu.store(shard.target_cpu, std::memory_order_relaxed);
+        }
+    }
+
+    UDPReceiver& receiver = *shard.receiver;
+    while (running_.load(std::memory_order_relaxed)) {
+        receiver.poll(WORKER_POLL_MS);
+        const UDPReceiver::ReceiveStats& stats = receiver.getReceiveStats();
+        shard.datagrams.store(stats.datagrams, std::memory_order_relaxed);
+        shard.syscalls.store(stats.syscalls, std::memory_order_relaxed);
+        shard.invalid.store(stats.invalid, std::memory_order_relaxed);
+    }
+}
+
+ShardedReceiver::ShardStats ShardedReceiver::getShardStats(size_t shard) const {
+    ShardStats stats;
+    if (shard >= shards_.size()) return stats;
+    const Shard& s = *shards_[shard];
+    stats.datagrams = s.datagrams.load(std::memory_order_relaxed);
+    stats.syscalls = s.syscalls.load(std::memory_order_relaxed);
+    stats.invalid = s.invalid.load(std::memory_order_relaxed);
+    stats.cpu = s.cpu.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ShardedReceiver::ShardStats ShardedReceiver::getTotalStats() const {
+    ShardStats total;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        ShardStats stats = getShardStats(i);
+        total.datagrams += stats.datagrams;
+        total.syscalls += stats.syscalls;
+        total.invalid += stats.invalid;
+    }
+    return total;
+}
@@ -0,0 +1,312 @@
+/*
+ * Shared-Memory Transport Implementation
+ */
+
+#include "shm_transport.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <new>
+
+using shm_transport::Header;
+using shm_transport::Slot;
+
+static_assert(shm_transport::SLOT_WORDS * 8 <= sizeof(xbox_udp::EventBuffer), "Slot larger than EventBuffer");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "Shared-memory atomics must be lock-free");
+
+namespace {
+
+size_t slots_offset() {
+    return (sizeof(Header) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+}
+
+std::string shm_path(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+long futex(std::atomic<uint32_t>& word, int op, uint32_t value, const struct timespec* timeout) {
+    // Shared futex (no FUTEX_PRIVATE_FLAG): waiters and waker are different processes
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+// Tell readers still mapping an old segment of this name (e.g. from a crashed
+// publisher) that it is dead, so they reopen and find the new one
+void close_stale(const std::string& path) {
+    int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+        void* addr = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            Header* header = static_cast<Header*>(addr);
+            if (header->magic.load(std::memory_order_acquire) == shm_transport::SHM_MAGIC) {
+                header->closed.store(1, std::memory_order_release);
+                header->futex.fetch_add(1);
+                futex(header->futex, FUTEX_WAKE, INT_MAX, nullptr);
+            }
+            munmap(addr, sizeof(Header));
+        }
+    }
+    ::close(fd);
+}
+
+}  // namespace
+
+size_t shm_transport::segmentSize(size_t slots) {
+    return slots_offset() + slots * sizeof(Slot);
+}
+
+ShmPublisher::ShmPublisher(const std::string& name, size_t slots) : name_(shm_path(name)) {
+    open_frame_.fill(-1);
+    size_t slot_count = 1;
+    while (slot_count < std::max<size_t>(slots, 2)) slot_count <<= 1;
+
+    // Readers of a stale segment keep their mapping; new readers find the new one
+    close_stale(name_);
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        std::cerr << "shm_open " << name_ << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    const size_t size = shm_transport::segmentSize(slot_count);
+    if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+        std::cerr << "ftruncate " << name_ << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        shm_unlink(name_.c_str());
+        return;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "mmap " << name_ << ": " << std::strerror(errno) << std::endl;
+        shm_unlink(name_.c_str());
+        return;
+    }
+
+    // The pages are zero, i.e. every slot unwritten; construct the atomics in place
+    Header* header = new (addr) Header();
+    header->version = shm_transport::SHM_VERSION;
+    header->slot_count = static_cast<uint32_t>(slot_count);
+    slots_ = reinterpret_cast<Slot*>(static_cast<char*>(addr) + slots_offset());
+    for (size_t i = 0; i < slot_count; ++i) {
+        new (&slots_[i]) Slot();
+        slots_[i].seq.store(0, std::memory_order_relaxed);
+    }
+    header->magic.store(shm_transport::SHM_MAGIC, std::memory_order_release);
+    header_ = header;
+    size_ = size;
+    frames_.reserve(16);
+}
+
+ShmPublisher::~ShmPublisher() {
+    if (!header_) return;
+    header_->closed.store(1, std::memory_order_release);
+    header_->futex.fetch_add(1);
+    futex(header_->futex, FUTEX_WAKE, INT_MAX, nullptr);
+    munmap(header_, size_);
+    shm_unlink(name_.c_str());
+}
+
+bool ShmPublisher::queueEvent(const xbox_udp::InputEventPacket& pkt) {
+    if (!header_) return false;
+
+    int16_t index = open_frame_[pkt.device_id];
+    if (index < 0 || frames_[index].header.count >= xbox_udp::MAX_FRAME_ENTRIES) {
+        index = static_cast<int16_t>(frames_.size());
+        frames_.emplace_back();
+        xbox_udp::FrameHeader& header = frames_.back().header;
+        header.magic = xbox_udp::FRAME_MAGIC;
+        header.version = xbox_udp::FRAME_VERSION;
+        header.device_id = pkt.device_id;
+        header.count = 0;
+        header.history = 0;
+        header.seq = next_seq_[pkt.device_id]++;
+        header.flags = 0;
+        header.timestamp_ns = xbox_udp::toTimestampNs(pkt.sec, pkt.usec);
+        open_frame_[pkt.device_id] = index;
+    }
+
+    xbox_udp::FramePacket& frame = frames_[index];
+    xbox_udp::FrameEntry& entry = frame.entries[frame.header.count++];
+    entry.type = pkt.type;
+    entry.code = pkt.code;
+    entry.value = pkt.value;
+    xbox_udp::encodeNormalized(pkt.normalized, entry);
+    return true;
+}
+
+bool ShmPublisher::flush() {
+    if (!header_) return false;
+    if (frames_.empty()) return true;
+
+    const uint64_t mask = header_->slot_count - 1;
+    for (const auto& frame : frames_) {
+        uint64_t words[shm_transport::SLOT_WORDS];
+        const size_t len = xbox_udp::frameSize(frame.header.count, frame.header.history);
+        std::memcpy(words, &frame, len);
+
+        Slot& slot = slots_[write_pos_ & mask];
+        slot.seq.store(2 * write_pos_ + 1, std::memory_order_relaxed);  // Odd: being written
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < (len + 7) / 8; ++i) {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.seq.store(2 * write_pos_ + 2, std::memory_order_release);
+        ++write_pos_;
+    }
+    stats_.frames += frames_.size();
+    ++stats_.flushes;
+    frames_.clear();
+    open_frame_.fill(-1);
+
+    header_->write_pos.store(write_pos_, std::memory_order_release);
+    // Bump the futex word before looking for waiters: a reader that registers
+    // after this either sees the new frames or finds the word changed
+    header_->futex.fetch_add(1, std::memory_order_seq_cst);
+    if (header_->waiters.load(std::memory_order_seq_cst) > 0) {
+        futex(header_->futex, FUTEX_WAKE, INT_MAX, nullptr);
+        ++stats_.wakeups;
+    }
+    return true;
+}
+
+void ShmPublisher::publishState(const xbox_udp::StatePacket& state) {
+    if (!header_) return;
+    header_->states[state.device_id].store(state);
+}
+
+ShmReader::ShmReader(const std::string& name) : name_(shm_path(name)) {}
+
+ShmReader::~ShmReader() {
+    close();
+}
+
+void ShmReader::close() {
+    if (header_) munmap(header_, size_);
+    header_ = nullptr;
+    slots_ = nullptr;
+}
+
+bool ShmReader::open() {
+    close();
+    // Read-write: blocked readers register in Header::waiters
+    int fd = shm_open(name_.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        std::cerr << "shm_open " << name_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < shm_transport::segmentSize(2)) {
+        std::cerr << "shm " << name_ << ": not a transport segment" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "mmap " << name_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    Header* header = static_cast<Header*>(addr);
+    if (header->magic.load(std::memory_order_acquire) != shm_transport::SHM_MAGIC ||
+        header->version != shm_transport::SHM_VERSION ||
+        shm_transport::segmentSize(header->slot_count) != size) {
+        std::cerr << "shm " << name_ << ": not ready or incompatible" << std::endl;
+        munmap(addr, size);
+        return false;
+    }
+    header_ = header;
+    size_ = size;
+    slots_ = reinterpret_cast<const Slot*>(static_cast<const char*>(addr) + slots_offset());
+    mask_ = header->slot_count - 1;
+    read_pos_ = header->write_pos.load(std::memory_order_acquire);
+    return true;
+}
+
+bool ShmReader::isClosed() const {
+    return !header_ || header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+const xbox_udp::FramePacket* ShmReader::next() {
+    if (!header_) return nullptr;
+    for (;;) {
+        const uint64_t write_pos = header_->write_pos.load(std::memory_order_acquire);
+        if (read_pos_ == write_pos) return nullptr;
+        if (write_pos - read_pos_ > mask_ + 1) {
+            // More than a ring behind: the oldest slots were overwritten
+            stats_.lost += write_pos - read_pos_ - (mask_ + 1);
+            read_pos_ = write_pos - (mask_ + 1);
+        }
+
+        const Slot& slot = slots_[read_pos_ & mask_];
+        const uint64_t expected = 2 * read_pos_ + 2;
+        const uint64_t before = slot.seq.load(std::memory_order_acquire);
+        if (before != expected) {
+            // Overwritten (or being overwritten) by a newer frame
+            ++stats_.lost;
+            ++read_pos_;
+            continue;
+        }
+
+        uint64_t* words = reinterpret_cast<uint64_t*>(buf_.data);
+        const size_t header_words = (xbox_udp::FRAME_HEADER_SIZE + 7) / 8;
+        for (size_t i = 0; i < header_words; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        const auto* frame = reinterpret_cast<const xbox_udp::FramePacket*>(buf_.data);
+        const size_t count = std::min<size_t>(frame->header.count, xbox_udp::MAX_FRAME_ENTRIES);
+        const size_t history = std::min<size_t>(frame->header.history, xbox_udp::MAX_FRAME_HISTORY);
+        const size_t len_words = (xbox_udp::frameSize(count, history) + 7) / 8;
+        for (size_t i = header_words; i < len_words; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ++read_pos_;
+        if (slot.seq.load(std::memory_order_relaxed) != expected) {
+            ++stats_.lost;  // Torn: overwritten while we copied it
+            continue;
+        }
+        ++stats_.frames;
+        return frame;
+    }
+}
+
+void ShmReader::wait(int timeout_ms) {
+    // Load the futex word before checking for data: a flush() after the check
+    // changes the word, and FUTEX_WAIT then returns at once
+    const uint32_t seen = header_->futex.load(std::memory_order_acquire);
+    if (header_->write_pos.load(std::memory_order_acquire) != read_pos_ ||
+        header_->closed.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000L;
+    header_->waiters.fetch_add(1, std::memory_order_seq_cst);
+    if (futex(header_->futex, FUTEX_WAIT, seen, timeout_ms < 0 ? nullptr : &timeout) < 0 &&
+        errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+        std::cerr << "futex wait: " << std::strerror(errno) << std::endl;
+    }
+    header_->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    ++stats_.waits;
+}
+
+bool ShmReader::readState(uint8_t device_id, xbox_udp::StatePacket& out) const {
+    if (!header_ || header_->states[device_id].version() == 0) return false;
+    header_->states[device_id].load(out);
+    return true;
+}
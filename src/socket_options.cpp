@@ -0,0 +1,120 @@
+/*
+ * Socket Options Profile Implementation
+ */
+
+#include "socket_options.hpp"
+
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+namespace socket_util {
+
+namespace {
+
+bool parseInt(const std::string& text, int min, int max, int& out) {
+    try {
+        size_t end = 0;
+        const long value = std::stol(text, &end, 0);
+        if (end != text.size() || value < min || value > max) return false;
+        out = static_cast<int>(value);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+constexpr int MAX_BUFFER = 1 << 30;
+
+}  // namespace
+
+bool parseDscp(const std::string& text, int& dscp) {
+    std::string name = text;
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    if (name == "EF") {
+        dscp = DSCP_EF;
+        return true;
+    }
+    // Class selectors CSn = 8n; assured forwarding AFxy = 8x + 2y
+    if (name.size() == 3 && name.compare(0, 2, "CS") == 0 && name[2] >= '0' && name[2] <= '7') {
+        dscp = (name[2] - '0') * 8;
+        return true;
+    }
+    if (name.size() == 4 && name.compare(0, 2, "AF") == 0 && name[2] >= '1' && name[2] <= '4' &&
+        name[3] >= '1' && name[3] <= '3') {
+        dscp = (name[2] - '0') * 8 + (name[3] - '0') * 2;
+        return true;
+    }
+    return parseInt(text, 0, 63, dscp);
+}
+
+std::string dscpName(int dscp) {
+    if (dscp == DSCP_EF) return "EF";
+    if (dscp >= 0 && dscp < 64 && dscp % 8 == 0) return "CS" + std::to_string(dscp / 8);
+    const int af_class = dscp / 8;
+    const int drop = (dscp % 8) / 2;
+    if (af_class >= 1 && af_class <= 4 && dscp % 2 == 0 && drop >= 1 && drop <= 3) {
+        return "AF" + std::to_string(af_class) + std::to_string(drop);
+    }
+    return std::to_string(dscp);
+}
+
+bool setSocketOption(SocketOptions& options, const std::string& name, const std::string& value) {
+    bool ok;
+    if (name == "busy-poll") {
+        ok = parseInt(value, 0, 1000000, options.busy_poll_us);
+    } else if (name == "priority") {
+        ok = parseInt(value, 0, 255, options.priority);
+    } else if (name == "dscp") {
+        ok = parseDscp(value, options.dscp);
+    } else if (name == "sndbuf") {
+        ok = parseInt(value, 1, MAX_BUFFER, options.sndbuf);
+    } else if (name == "rcvbuf") {
+        ok = parseInt(value, 1, MAX_BUFFER, options.rcvbuf);
+    } else if (name == "rcvlowat") {
+        ok = parseInt(value, 1, MAX_BUFFER, options.rcvlowat);
+    } else {
+        std::cerr << "Unknown socket option: " << name << std::endl;
+        return false;
+    }
+    if (!ok) {
+        std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+    }
+    return ok;
+}
+
+bool loadSocketOptions(const std::string& path, SocketOptions& options) {
+    try {
+        YAML::Node config = YAML::LoadFile(path);
+        YAML::Node socket = config["socket"];
+        if (!socket) {
+            std::cerr << "Socket profile " << path << ": no socket section" << std::endl;
+            return false;
+        }
+
+        const struct {
+            const char* key;
+            const char* option;
+        } keys[] = {
+            {"busy_poll_us", "busy-poll"},
+            {"priority", "priority"},
+            {"dscp", "dscp"},
+            {"sndbuf", "sndbuf"},
+            {"rcvbuf", "rcvbuf"},
+            {"rcvlowat", "rcvlowat"},
+        };
+        for (const auto& key : keys) {
+            if (socket[key.key] && !setSocketOption(options, key.option, socket[key.key].as<std::string>())) {
+                std::cerr << "Socket profile " << path << ": bad " << key.key << std::endl;
+                return false;
+            }
+        }
+        return true;
+    } catch (const YAML::Exception& e) {
+        std::cerr << "Error loading socket profile " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+}  // namespace socket_util
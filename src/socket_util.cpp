@@ -0,0 +1,191 @@
+/*
+ * Socket Utilities Implementation
+ */
+
+#include "socket_util.hpp"
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace socket_util {
+
+Address::Address() : len(0) {
+    std::memset(&un, 0, sizeof(un));
+}
+
+bool Address::operator==(const Address& other) const {
+    return len == other.len && std::memcmp(&sa, &other.sa, len) == 0;
+}
+
+std::string Address::toString() const {
+    if (family() == AF_UNIX) {
+        const size_t path_len = len > offsetof(struct sockaddr_un, sun_path) ?
+                                len - offsetof(struct sockaddr_un, sun_path) : 0;
+        std::string path(un.sun_path, path_len);
+        if (!path.empty() && path[0] == '\0') {
+            path[0] = '@';
+        } else {
+            path = path.c_str();  // Drop the terminator
+        }
+        return UNIX_PREFIX + path;
+    }
+    char host[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &in.sin_addr, host, sizeof(host));
+    return std::string(host) + ":" + std::to_string(ntohs(in.sin_port));
+}
+
+bool isUnixEndpoint(const std::string& spec) {
+    return spec.compare(0, std::strlen(UNIX_PREFIX), UNIX_PREFIX) == 0;
+}
+
+bool parseEndpoint(const std::string& spec, unsigned short port, Address& addr) {
+    addr = Address();
+    if (!isUnixEndpoint(spec)) {
+        if (!parseAddress(spec, port, addr.in)) return false;
+        addr.len = sizeof(addr.in);
+        return true;
+    }
+
+    const std::string path = spec.substr(std::strlen(UNIX_PREFIX));
+    if (path.empty() || path.size() >= sizeof(addr.un.sun_path)) {
+        std::cerr << spec << ": invalid Unix socket path" << std::endl;
+        return false;
+    }
+    addr.un.sun_family = AF_UNIX;
+    std::memcpy(addr.un.sun_path, path.data(), path.size());
+    if (path[0] == '@') {
+        // Abstract: leading NUL, and the length (not a terminator) ends the name
+        addr.un.sun_path[0] = '\0';
+        addr.len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size());
+    } else {
+        addr.len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size() + 1);
+    }
+    return true;
+}
+
+bool isMulticast(const struct in_addr& addr) {
+    return IN_MULTICAST(ntohl(addr.s_addr));
+}
+
+bool parseAddress(const std::string& host, unsigned short port, struct sockaddr_in& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0) {
+        std::cerr << "inet_pton " << host << ": invalid address" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool resolveInterface(const std::string& iface, struct ip_mreqn& mreq) {
+    std::memset(&mreq, 0, sizeof(mreq));
+    if (iface.empty()) {
+        mreq.imr_address.s_addr = htonl(INADDR_ANY);
+        return true;
+    }
+    if (inet_pton(AF_INET, iface.c_str(), &mreq.imr_address) == 1) {
+        return true;
+    }
+    mreq.imr_ifindex = static_cast<int>(if_nametoindex(iface.c_str()));
+    if (mreq.imr_ifindex == 0) {
+        std::cerr << "interface " << iface << ": not found" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+int socketFamily(int sock) {
+    int family = AF_UNSPEC;
+    socklen_t len = sizeof(family);
+    getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &family, &len);
+    return family;
+}
+
+int socketType(int sock) {
+    int type = 0;
+    socklen_t len = sizeof(type);
+    getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &len);
+    return type;
+}
+
+bool setIntOption(int sock, int level, int name, int value, const char* option, const char* label) {
+    if (setsockopt(sock, level, name, &value, sizeof(value)) < 0) {
+        std::cerr << "setsockopt " << option << " " << value << " (" << label << "): "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Past net.core.{w,r}mem_max only with CAP_NET_ADMIN; without it the kernel caps the size
+bool setBufferOption(int sock, int force, int name, int value, const char* option, const char* label) {
+    if (setsockopt(sock, SOL_SOCKET, force, &value, sizeof(value)) == 0) return true;
+    return setIntOption(sock, SOL_SOCKET, name, value, option, label);
+}
+
+int getIntOption(int sock, int level, int name) {
+    int value = -1;
+    socklen_t len = sizeof(value);
+    if (getsockopt(sock, level, name, &value, &len) < 0) return -1;
+    return value;
+}
+
+}  // namespace
+
+bool applySocketOptions(int sock, const SocketOptions& options, const char* label) {
+    bool ok = true;
+    // IP_TOS also sets the priority from the TOS bits: an explicit priority goes after it
+    if (options.dscp >= 0) {
+        if (socketFamily(sock) == AF_INET) {
+            ok = setIntOption(sock, IPPROTO_IP, IP_TOS, options.dscp << 2, "IP_TOS", label) && ok;
+        } else {
+            std::cerr << "dscp (" << label << "): not an IPv4 socket, ignored" << std::endl;
+        }
+    }
+    if (options.priority >= 0) {
+        ok = setIntOption(sock, SOL_SOCKET, SO_PRIORITY, options.priority, "SO_PRIORITY", label) && ok;
+    }
+    if (options.busy_poll_us >= 0) {
+        ok = setIntOption(sock, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_us, "SO_BUSY_POLL", label) && ok;
+    }
+    if (options.sndbuf >= 0) {
+        ok = setBufferOption(sock, SO_SNDBUFFORCE, SO_SNDBUF, options.sndbuf, "SO_SNDBUF", label) && ok;
+    }
+    if (options.rcvbuf >= 0) {
+        ok = setBufferOption(sock, SO_RCVBUFFORCE, SO_RCVBUF, options.rcvbuf, "SO_RCVBUF", label) && ok;
+    }
+    if (options.rcvlowat >= 0) {
+        // Datagram sockets are readable with any datagram queued: poll() never checks it
+        if (socketType(sock) == SOCK_DGRAM) {
+            std::cerr << "rcvlowat (" << label << "): no effect on datagram sockets, ignored" << std::endl;
+        } else {
+            ok = setIntOption(sock, SOL_SOCKET, SO_RCVLOWAT, options.rcvlowat, "SO_RCVLOWAT", label) && ok;
+        }
+    }
+    return ok;
+}
+
+std::string describeSocketOptions(int sock) {
+    std::ostringstream out;
+    out << "busy_poll " << getIntOption(sock, SOL_SOCKET, SO_BUSY_POLL) << " us"
+        << ", priority " << getIntOption(sock, SOL_SOCKET, SO_PRIORITY);
+    if (socketFamily(sock) == AF_INET) {
+        const int tos = getIntOption(sock, IPPROTO_IP, IP_TOS);
+        const int dscp = tos >= 0 ? tos >> 2 : -1;
+        out << ", dscp " << dscpName(dscp);
+        if (dscpName(dscp) != std::to_string(dscp)) out << " (" << dscp << ")";
+    }
+    out << ", sndbuf " << getIntOption(sock, SOL_SOCKET, SO_SNDBUF)
+        << ", rcvbuf " << getIntOption(sock, SOL_SOCKET, SO_RCVBUF)
+        << ", rcvlowat " << getIntOption(sock, SOL_SOCKET, SO_RCVLOWAT);
+    return out.str();
+}
+
+}  // namespace socket_util
@@ -0,0 +1,71 @@
+/*
+ * State Snapshots Implementation
+ */
+
+#include "state_snapshot.hpp"
+
+StateSnapshots::StateSnapshots() : slots_(new Slot[256]) {}
+
+void StateSnapshots::attach(UDPReceiver& receiver) {
+    receiver.setEventCallback([this](const xbox_udp::InputEventPacket& pkt) { apply(pkt); });
+    receiver.setFrameCallback([this](const xbox_udp::FramePacket& frame) { apply(frame); });
+    receiver.setStateCallback([this](const xbox_udp::StatePacket& state) { apply(state); });
+}
+
+void StateSnapshots::applyEvent(ControllerSnapshot& snap, uint16_t type, uint16_t code,
+                                int32_t value, double normalized) {
+    if (type == 0x01 && xbox_udp::stateHasKey(code)) {  // EV_KEY
+        xbox_udp::setStateBit(snap.buttons, code - xbox_udp::STATE_KEY_BASE, value != 0);
+    } else if (type == 0x03 && code < xbox_udp::STATE_AXIS_COUNT) {  // EV_ABS
+        snap.axis_mask |= 1u << code;
+        snap.axes[code] = value;
+        snap.normalized[code] = normalized;
+    }
+}
+
+void StateSnapshots::publish(Slot& slot, uint64_t timestamp_ns) {
+    slot.working.timestamp_ns = timestamp_ns;
+    ++slot.working.updates;
+    slot.published.store(slot.working);
+}
+
+void StateSnapshots::apply(const xbox_udp::InputEventPacket& pkt) {
+    if (pkt.type == 0x00) return;  // EV_SYN
+    Slot& slot = slots_[pkt.device_id];
+    applyEvent(slot.working, pkt.type, pkt.code, pkt.value, pkt.normalized);
+    publish(slot, xbox_udp::toTimestampNs(pkt.sec, pkt.usec));
+}
+
+void StateSnapshots::apply(const xbox_udp::FramePacket& frame) {
+    // A whole report becomes visible at once, so stick X/Y never tear
+    Slot& slot = slots_[frame.header.device_id];
+    for (uint8_t i = 0; i < frame.header.count; ++i) {
+        const xbox_udp::FrameEntry& entry = frame.entries[i];
+        applyEvent(slot.working, entry.type, entry.code, entry.value, xbox_udp::decodeNormalized(entry));
+    }
+    publish(slot, frame.header.timestamp_ns);
+}
+
+void StateSnapshots::apply(const xbox_udp::StatePacket& state) {
+    Slot& slot = slots_[state.device_id];
+    ControllerSnapshot& snap = slot.working;
+    for (size_t i = 0; i < xbox_udp::STATE_KEY_COUNT / 64; ++i) {
+        snap.buttons[i] = (snap.buttons[i] & ~state.key_mask[i]) | (state.buttons[i] & state.key_mask[i]);
+    }
+    for (unsigned i = 0; i < xbox_udp::STATE_AXIS_COUNT; ++i) {
+        if (!((state.axis_mask >> i) & 1u)) continue;
+        snap.axes[i] = state.axes[i];
+        snap.normalized[i] = ((state.normalized_mask >> i) & 1u)
+            ? static_cast<double>(state.normalized[i]) / xbox_udp::NORMALIZED_SCALE
+            : static_cast<double>(state.axes[i]);
+    }
+    snap.axis_mask |= state.axis_mask;
+    publish(slot, state.timestamp_ns);
+}
+
+bool StateSnapshots::read(uint8_t device_id, ControllerSnapshot& out) const {
+    const Seqlock<ControllerSnapshot>& published = slots_[device_id].published;
+    if (published.version() == 0) return false;
+    published.load(out);
+    return true;
+}
@@ -0,0 +1,1386 @@
+/*
+ * UDP Benchmarks
+ *
+ * Loopback micro-benchmarks for the UDP publisher/receiver paths.
+ * Usage: ./udp_bench [benchmark] [options]
+ *
+ * Benchmarks:
+ *   batch   Syscalls per report and CPU per event: send() per event vs.
+ *           queueEvent() + flush() (one sendmmsg() per report)
+ *   fanout  CPU per event as destinations go from 1 to 32: one publisher per
+ *           destination vs. one publisher encoding once for all of them
+ *   recv    Max sustained receive rate under a saturating sender: one recv() per
+ *           poll() wakeup vs. UDPReceiver::poll() draining with recvmmsg()
+ *   shard   Receive rate of a ShardedReceiver (SO_REUSEPORT, one pinned thread
+ *           per shard) fed by many publishers, from 1 to N shards
+ *   snapshot  Latest-state reads under contention: 1 writer, N readers, seqlock
+ *           vs. mutex
+ *   handler Receive CPU per packet: std::function callbacks (UDPReceiver) vs.
+ *           an inlined handler (UDPReceiverT<Handler>)
+ *   jitter  Playout smoothness of clumped (Wi-Fi-like) arrivals, simulated:
+ *           no buffer vs. fixed and adaptive jitter buffer delays
+ *   predict Stick error while reports are lost, simulated: holding the last
+ *           value vs. AxisPredictor extrapolation, and the predictor's CPU cost
+ *   shm     Same-host delivery of 1 kHz reports to a blocking reader: loopback
+ *           UDP vs. the shared-memory ring (latency percentiles, CPU per report)
+ *   unix    The same over loopback UDP vs. Unix datagram sockets (path and
+ *           abstract address)
+ *   gso     Sender throughput (datagrams per CPU second) for bursts of 1 to 64
+ *           keyframes: sendmmsg() vs. UDP_SEGMENT messages
+ *   uring   joystick's event loop between a simulated device (a pipe fed 1 kHz
+ *           reports) and a receiver: poll() + read() + sendmmsg() vs. io_uring
+ *           (syscalls, loop CPU and latency per report)
+ */
+
+#include "axis_predictor.hpp"
+#ifdef XBOX_HAVE_IO_URING
+#include "io_ring.hpp"
+#endif
+#include "jitter_buffer.hpp"
+#include "latency_histogram.hpp"
+#include "seqlock.hpp"
+#include "sharded_receiver.hpp"
+#include "shm_transport.hpp"
+#include "state_snapshot.hpp"
+#include "udp_publisher.hpp"
+#include "udp_receiver.hpp"
+#include "xbox_udp_protocol.hpp"
+
+#include <linux/input.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    unsigned long reports = 200000;
+    unsigned events_per_report = 3;
+    double seconds = 2.0;
+    size_t shards = 0;      // 0 = number of CPUs
+    unsigned senders = 8;
+    unsigned readers = 8;
+};
+
+uint64_t thread_cpu_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint64_t cpu_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Bind a UDP socket on 127.0.0.1 with an ephemeral port. Nothing reads from it;
+// once its receive buffer is full the kernel drops, which keeps sends cheap and steady.
+int open_sink(unsigned short& port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        std::cerr << "socket: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &len) < 0) {
+        std::cerr << "bind sink: " << std::strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return sock;
+}
+
+// Synthetic stick sweep: each report touches ABS_X, ABS_Y, ABS_RX, ...
+void make_event(xbox_udp::InputEventPacket& pkt, unsigned long report, unsigned i) {
+    pkt.magic = xbox_udp::PACKET_MAGIC;
+    pkt.device_id = 0;
+    pkt.type = EV_ABS;
+    pkt.code = static_cast<uint16_t>(ABS_X + i);
+    pkt.value = static_cast<int32_t>((report * 97 + i) % 65536) - 32768;
+    pkt.normalized = pkt.value / 32768.0;
+    pkt.sec = static_cast<uint32_t>(report / 1000);
+    pkt.usec = static_cast<uint32_t>((report % 1000) * 1000);
+}
+
+void print_row(const char* label, const UDPPublisher::Stats& stats,
+               const BenchOptions& opt, uint64_t cpu_ns) {
+    const double events = static_cast<double>(opt.reports) * opt.events_per_report;
+    std::cout << "  " << std::setw(18) << std::left << label
+              << std::setw(10) << std::right << std::fixed << std::setprecision(3)
+              << static_cast<double>(stats.syscalls) / opt.reports << " syscalls/report"
+              << std::setw(10) << std::setprecision(1) << cpu_ns / events << " ns CPU/event"
+              << "  (" << stats.datagrams << " datagrams, " << stats.errors << " errors)"
+              << std::endl;
+}
+
+int bench_batch(const BenchOptions& opt) {
+    unsigned short port = 0;
+    int sink = open_sink(port);
+    if (sink < 0) return 1;
+
+    std::cout << "batch: " << opt.reports << " reports x " << opt.events_per_report
+              << " events -> 127.0.0.1:" << port << std::endl;
+
+    xbox_udp::InputEventPacket pkt;
+
+    // Before: one send() per event
+    {
+        UDPPublisher publisher("127.0.0.1", port);
+        if (!publisher.isConnected()) {
+            close(sink);
+            return 1;
+        }
+        uint64_t start = cpu_time_ns();
+        for (unsigned long r = 0; r < opt.reports; ++r) {
+            for (unsigned i = 0; i < opt.events_per_report; ++i) {
+                make_event(pkt, r, i);
+                publisher.sendEvent(pkt);
+            }
+        }
+        print_row("send per event", publisher.getStats(), opt, cpu_time_ns() - start);
+    }
+
+    // After: queue the report, flush at SYN_REPORT with one sendmmsg()
+    {
+        UDPPublisher publisher("127.0.0.1", port);
+        if (!publisher.isConnected()) {
+            close(sink);
+            return 1;
+        }
+        uint64_t start = cpu_time_ns();
+        for (unsigned long r = 0; r < opt.reports; ++r) {
+            for (unsigned i = 0; i < opt.events_per_report; ++i) {
+                make_event(pkt, r, i);
+                publisher.queueEvent(pkt);
+            }
+            publisher.flush();
+        }
+        print_row("sendmmsg/report", publisher.getStats(), opt, cpu_time_ns() - start);
+    }
+
+    close(sink);
+    return 0;
+}
+
+// Publish opt.reports frame-format reports through every publisher; returns CPU ns
+uint64_t run_frames(std::vector<UDPPublisher*>& publishers, const BenchOptions& opt) {
+    xbox_udp::InputEventPacket pkt;
+    uint64_t start = cpu_time_ns();
+    for (unsigned long r = 0; r < opt.reports; ++r) {
+        for (UDPPublisher* publisher : publishers) {
+            for (unsigned i = 0; i < opt.events_per_report; ++i) {
+                make_event(pkt, r, i);
+                publisher->queueEvent(pkt);
+            }
+            publisher->flush();
+        }
+    }
+    return cpu_time_ns() - start;
+}
+
+int bench_fanout(const BenchOptions& opt) {
+    static const size_t MAX_DESTS = 32;
+    std::vector<int> sinks;
+    std::vector<unsigned short> ports;
+    for (size_t i = 0; i < MAX_DESTS; ++i) {
+        unsigned short port = 0;
+        int sink = open_sink(port);
+        if (sink < 0) break;
+        sinks.push_back(sink);
+        ports.push_back(port);
+    }
+
+    std::cout << "fanout: " << opt.reports << " reports x " << opt.events_per_report
+              << " events (frame format), CPU per source event" << std::endl;
+    std::cout << "  " << std::setw(6) << std::right << "dests"
+              << std::setw(21) << "per-dest publisher" << std::setw(18) << "encode once"
+              << std::setw(25) << "syscalls/report (once)" << std::endl;
+
+    const double events = static_cast<double>(opt.reports) * opt.events_per_report;
+    int result = sinks.size() == MAX_DESTS ? 0 : 1;
+    for (size_t n = 1; n <= sinks.size(); n *= 2) {
+        // Before: N publishers (N sockets, N encodes, N sendmmsg() per report)
+        std::vector<std::unique_ptr<UDPPublisher>> owned;
+        std::vector<UDPPublisher*> separate;
+        for (size_t i = 0; i < n; ++i) {
+            owned.emplace_back(new UDPPublisher("127.0.0.1", ports[i]));
+            owned.back()->setFormat(UDPPublisher::Format::Frame);
+            separate.push_back(owned.back().get());
+        }
+        const uint64_t separate_ns = run_frames(separate, opt);
+
+        // After: one publisher, one encode, one sendmmsg() for all destinations
+        UDPPublisher fanout("127.0.0.1", ports[0]);
+        fanout.setFormat(UDPPublisher::Format::Frame);
+        for (size_t i = 1; i < n; ++i) {
+            fanout.addDestination("127.0.0.1", ports[i]);
+        }
+        std::vector<UDPPublisher*> single{&fanout};
+        const uint64_t fanout_ns = run_frames(single, opt);
+
+        std::cout << "  " << std::setw(6) << n << std::fixed << std::setprecision(1)
+                  << std::setw(18) << separate_ns / events << " ns"
+                  << std::setw(15) << fanout_ns / events << " ns"
+                  << std::setw(25) << std::setprecision(3)
+                  << static_cast<double>(fanout.getStats().syscalls) / opt.reports << std::endl;
+        if (fanout.getStats().errors > 0) result = 1;
+    }
+
+    for (int sink : sinks) close(sink);
+    return result;
+}
+
+// Saturate 127.0.0.1:port with one-entry frames from a sender thread for opt.seconds
+// while `receive(deadline)` runs on this thread; returns datagrams sent and the
+// receiving thread's CPU time
+template <typename Receive>
+uint64_t run_flood(unsigned short port, const BenchOptions& opt, uint64_t& receiver_cpu_ns,
+                   Receive&& receive) {
+    std::atomic<bool> stop{false};
+    uint64_t sent = 0;
+    std::thread sender([&]() {
+        UDPPublisher publisher("127.0.0.1", port);
+        publisher.setFormat(UDPPublisher::Format::Compact);
+        xbox_udp::InputEventPacket pkt;
+        for (unsigned long r = 0; !stop.load(std::memory_order_relaxed); ++r) {
+            for (unsigned i = 0; i < 32; ++i) {
+                make_event(pkt, r, i % 6);
+                publisher.queueEvent(pkt);
+            }
+            publisher.flush();
+        }
+        sent = publisher.getStats().datagrams;
+    });
+
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opt.seconds));
+    const uint64_t start = thread_cpu_time_ns();
+    receive(deadline);
+    receiver_cpu_ns = thread_cpu_time_ns() - start;
+    stop = true;
+    sender.join();
+    return sent;
+}
+
+void print_flood_row(const char* label, uint64_t sent, uint64_t received, uint64_t cpu_ns,
+                     const BenchOptions& opt) {
+    std::cout << "  " << std::setw(18) << std::left << label << std::right << std::fixed
+              << std::setprecision(0) << std::setw(10) << received / opt.seconds << " pkt/s received"
+              << std::setw(10) << sent / opt.seconds << " offered"
+              << std::setprecision(1) << std::setw(7)
+              << (sent ? 100.0 * (sent - std::min(sent, received)) / sent : 0.0) << "% dropped"
+              << std::setw(8) << (received ? static_cast<double>(cpu_ns) / received : 0.0)
+              << " ns receiver CPU/pkt" << std::endl;
+}
+
+// Burst of `burst` one-entry frames queued on the receiving socket before it wakes
+void send_burst(UDPPublisher& publisher, unsigned long round, unsigned burst) {
+    xbox_udp::InputEventPacket pkt;
+    for (unsigned i = 0; i < burst; ++i) {
+        make_event(pkt, round, i % 6);
+        publisher.queueEvent(pkt);
+    }
+    publisher.flush();
+}
+
+void print_burst_row(const char* label, uint64_t received, uint64_t syscalls, uint64_t cpu_ns,
+                     unsigned long rounds) {
+    std::cout << "  " << std::setw(18) << std::left << label << std::right << std::fixed
+              << std::setprecision(1) << std::setw(8) << static_cast<double>(syscalls) / rounds
+              << " syscalls/burst" << std::setw(8) << (received ? static_cast<double>(cpu_ns) / received : 0.0)
+              << " ns CPU/pkt  (" << received << " received)" << std::endl;
+}
+
+int bench_recv(const BenchOptions& opt) {
+    // Deterministic part: queue a burst, then wake the receiver once and let it catch up
+    const unsigned burst = 50;
+    const unsigned long rounds = std::max(1ul, opt.reports / 20);
+    std::cout << "recv: " << rounds << " bursts of " << burst << " datagrams queued before each wakeup"
+              << std::endl;
+    {
+        unsigned short port = 0;
+        int sock = open_sink(port);
+        if (sock < 0) return 1;
+        UDPPublisher publisher("127.0.0.1", port);
+        publisher.setFormat(UDPPublisher::Format::Compact);
+        uint64_t received = 0, syscalls = 0, cpu_ns = 0;
+        xbox_udp::EventBuffer buf;
+        struct pollfd pfd = {sock, POLLIN, 0};
+        for (unsigned long r = 0; r < rounds; ++r) {
+            send_burst(publisher, r, burst);
+            uint64_t start = thread_cpu_time_ns();
+            // Before: every datagram costs a poll() round trip and a recv()
+            for (;;) {
+                ++syscalls;
+                if (::poll(&pfd, 1, 0) <= 0) break;
+                ++syscalls;
+                if (recv(sock, buf.data, sizeof(buf.data), MSG_DONTWAIT) > 0) ++received;
+            }
+            cpu_ns += thread_cpu_time_ns() - start;
+        }
+        close(sock);
+        print_burst_row("recv per wakeup", received, syscalls, cpu_ns, rounds);
+    }
+    {
+        unsigned short port = 0;
+        int probe = open_sink(port);
+        if (probe < 0) return 1;
+        close(probe);
+        UDPReceiver receiver(port, 0);
+        if (!receiver.bind()) return 1;
+        uint64_t received = 0, cpu_ns = 0;
+        receiver.setFrameCallback([&received](const xbox_udp::FramePacket&) { ++received; });
+        UDPPublisher publisher("127.0.0.1", port);
+        publisher.setFormat(UDPPublisher::Format::Compact);
+        for (unsigned long r = 0; r < rounds; ++r) {
+            send_burst(publisher, r, burst);
+            uint64_t start = thread_cpu_time_ns();
+            receiver.poll(0);
+            cpu_ns += thread_cpu_time_ns() - start;
+        }
+        // One poll() plus the recvmmsg() calls; the short last batch ends the drain
+        const UDPReceiver::ReceiveStats& stats = receiver.getReceiveStats();
+        print_burst_row("recvmmsg drain", received, rounds + stats.syscalls, cpu_ns, rounds);
+    }
+
+    std::cout << "recv: saturating loopback sender, " << opt.seconds << " s per run" << std::endl;
+
+    // Before: one recv() per poll() wakeup
+    {
+        unsigned short port = 0;
+        int sock = open_sink(port);
+        if (sock < 0) return 1;
+        uint64_t received = 0;
+        uint64_t cpu_ns = 0;
+        uint64_t sent = run_flood(port, opt, cpu_ns, [&](std::chrono::steady_clock::time_point deadline) {
+            xbox_udp::EventBuffer buf;
+            struct pollfd pfd = {sock, POLLIN, 0};
+            while (std::chrono::steady_clock::now() < deadline) {
+                if (::poll(&pfd, 1, 10) > 0 && recv(sock, buf.data, sizeof(buf.data), MSG_DONTWAIT) > 0) {
+                    ++received;
+                }
+            }
+        });
+        close(sock);
+        print_flood_row("recv per wakeup", sent, received, cpu_ns, opt);
+    }
+
+    // After: UDPReceiver drains each wakeup with recvmmsg()
+    {
+        unsigned short port = 0;
+        int probe = open_sink(port);  // Find a free port, then hand it to the receiver
+        if (probe < 0) return 1;
+        close(probe);
+        UDPReceiver receiver(port, 0);
+        if (!receiver.bind()) return 1;
+        uint64_t received = 0;
+        receiver.setFrameCallback([&received](const xbox_udp::FramePacket&) { ++received; });
+        uint64_t cpu_ns = 0;
+        uint64_t sent = run_flood(port, opt, cpu_ns, [&](std::chrono::steady_clock::time_point deadline) {
+            while (std::chrono::steady_clock::now() < deadline) {
+                receiver.poll(10);
+            }
+        });
+        print_flood_row("recvmmsg drain", sent, received, cpu_ns, opt);
+
+        const UDPReceiver::ReceiveStats& stats = receiver.getReceiveStats();
+        std::cout << "  batch sizes (datagrams per recvmmsg: calls):";
+        for (size_t n = 1; n < stats.batch_sizes.size(); ++n) {
+            if (stats.batch_sizes[n]) std::cout << " " << n << ":" << stats.batch_sizes[n];
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// Sums the entry values so the handler work can't be optimized away
+struct SumHandler : PacketHandler {
+    uint64_t frames = 0;
+    int64_t sum = 0;
+    void onFrame(const xbox_udp::FramePacket& frame) {
+        ++frames;
+        for (uint8_t i = 0; i < frame.header.count; ++i) sum += frame.entries[i].value;
+    }
+};
+
+// Receiver CPU spent on queued bursts, per received packet
+template <typename Receiver>
+double run_handler_bursts(Receiver& receiver, unsigned short port, const uint64_t& received,
+                          const BenchOptions& opt) {
+    const unsigned burst = 32;  // One full recvmmsg() batch
+    const unsigned long rounds = std::max(1ul, opt.reports / 10);
+    UDPPublisher publisher("127.0.0.1", port);
+    publisher.setFormat(UDPPublisher::Format::Compact);
+    uint64_t cpu_ns = 0;
+    for (unsigned long r = 0; r < rounds; ++r) {
+        send_burst(publisher, r, burst);
+        const uint64_t start = thread_cpu_time_ns();
+        receiver.poll(0);
+        cpu_ns += thread_cpu_time_ns() - start;
+    }
+    return received ? static_cast<double>(cpu_ns) / received : 0.0;
+}
+
+int bench_handler(const BenchOptions& opt) {
+    std::cout << "handler: bursts of 32 compact frames, receive + dispatch CPU per packet" << std::endl;
+    for (int rep = 0; rep < 2; ++rep) {
+        {
+            unsigned short port = 0;
+            int probe = open_sink(port);
+            if (probe < 0) return 1;
+            close(probe);
+            UDPReceiver receiver(port, 0);
+            if (!receiver.bind()) return 1;
+            uint64_t frames = 0;
+            int64_t sum = 0;
+            receiver.setFrameCallback([&](const xbox_udp::FramePacket& frame) {
+                ++frames;
+                for (uint8_t i = 0; i < frame.header.count; ++i) sum += frame.entries[i].value;
+            });
+            const double ns = run_handler_bursts(receiver, port, frames, opt);
+            std::cout << "  " << std::left << std::setw(28) << "std::function callback" << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(8) << ns << " ns CPU/pkt  ("
+                      << frames << " received)" << std::endl;
+        }
+        {
+            unsigned short port = 0;
+            int probe = open_sink(port);
+            if (probe < 0) return 1;
+            close(probe);
+            UDPReceiverT<SumHandler> receiver(port, 0);
+            if (!receiver.bind()) return 1;
+            const double ns = run_handler_bursts(receiver, port, receiver.handler().frames, opt);
+            std::cout << "  " << std::left << std::setw(28) << "UDPReceiverT<SumHandler>" << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(8) << ns << " ns CPU/pkt  ("
+                      << receiver.handler().frames << " received)" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Records when each frame leaves the jitter buffer
+struct PlayoutRecorder : PacketHandler {
+    uint64_t now_ns = 0;
+    std::vector<uint64_t> times;
+    void onFrame(const xbox_udp::FramePacket&) { times.push_back(now_ns); }
+};
+
+void print_jitter_row(const char* label, const std::vector<uint64_t>& times, uint64_t interval_ns,
+                      const JitterBuffer::Stats* stats) {
+    double sum = 0, sum_sq = 0, max_gap = 0;
+    for (size_t i = 1; i < times.size(); ++i) {
+        const double gap = static_cast<double>(times[i] - times[i - 1]) / 1e6;
+        sum += gap;
+        sum_sq += gap * gap;
+        max_gap = std::max(max_gap, gap);
+    }
+    const double n = static_cast<double>(std::max<size_t>(times.size(), 2) - 1);
+    const double mean = sum / n;
+    std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed
+              << std::setprecision(2) << " interval " << mean << " ms (ideal "
+              << interval_ns / 1e6 << "), stddev " << std::setw(5)
+              << std::sqrt(std::max(0.0, sum_sq / n - mean * mean)) << " ms, max gap " << std::setw(6)
+              << max_gap << " ms";
+    if (stats) {
+        std::cout << ", added " << std::setprecision(1) << stats->meanAddedLatencyUs() / 1000.0
+                  << " ms avg / " << stats->max_added_latency_ns / 1e6 << " max, delay "
+                  << stats->delay_us / 1000.0 << " ms, " << stats->late << " late, "
+                  << stats->late_dropped << " dropped";
+    }
+    std::cout << std::endl;
+}
+
+int bench_jitter(const BenchOptions& opt) {
+    // 250 Hz reports; the link holds packets and delivers them in clumps every 20 ms,
+    // plus up to 1 ms of noise and a 1% chance of a 30 ms stall
+    const uint64_t interval_ns = 4000000;
+    const uint64_t clump_ns = 20000000;
+    const size_t count = std::max(100ul, opt.reports / 10);
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<uint64_t> noise(0, 1000000);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    std::vector<std::pair<uint64_t, uint64_t>> arrivals;  // (arrival, timestamp)
+    const uint64_t clock_offset = 5000000000ull;  // Sender and receiver clocks differ
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t ts = (i + 1) * interval_ns;
+        uint64_t arrival = (ts / clump_ns + 1) * clump_ns + 2000000 + noise(rng);
+        if (chance(rng) < 0.01) arrival += 30000000;
+        arrivals.emplace_back(arrival + clock_offset, ts);
+    }
+    std::sort(arrivals.begin(), arrivals.end());
+
+    std::cout << "jitter: " << count << " frames at 250 Hz arriving in 20 ms clumps (simulated clock)"
+              << std::endl;
+
+    std::vector<uint64_t> direct;
+    for (const auto& arrival : arrivals) direct.push_back(arrival.first);
+    print_jitter_row("no jitter buffer", direct, interval_ns, nullptr);
+
+    struct Run {
+        const char* label;
+        JitterBuffer::Config config;
+        size_t keyframe_every = 0;  // Frames between keyframes (joystick --keyframe-ms), 0 = none
+    };
+    std::vector<Run> runs(5);
+    runs[0].label = "fixed 10 ms";
+    runs[0].config.delay_us = 10000;
+    runs[1].label = "fixed 25 ms";
+    runs[1].config.delay_us = 25000;
+    runs[2].label = "adaptive 5..50 ms";
+    runs[2].config.delay_us = 5000;
+    runs[2].config.adaptive = true;
+    runs[2].config.max_delay_us = 50000;
+    // Keyframes must not release the smoothed queue early
+    runs[3] = runs[1];
+    runs[3].label = "fixed 25 ms, keyframes";
+    runs[3].keyframe_every = 25;  // Every 100 ms
+    runs[4] = runs[2];
+    runs[4].label = "adaptive, keyframes";
+    runs[4].keyframe_every = 25;
+
+    for (const Run& run : runs) {
+        JitterBuffer buffer(run.config);
+        PlayoutRecorder recorder;
+        xbox_udp::FramePacket frame;
+        std::memset(&frame, 0, sizeof(frame));
+        frame.header.magic = xbox_udp::FRAME_MAGIC;
+        frame.header.version = xbox_udp::FRAME_VERSION;
+        frame.header.count = 1;
+        xbox_udp::StatePacket keyframe;
+        std::memset(&keyframe, 0, sizeof(keyframe));
+        keyframe.magic = xbox_udp::STATE_MAGIC;
+        keyframe.version = xbox_udp::STATE_VERSION;
+        // Step a simulated clock in 100 us ticks, as a receiver polling for playout would
+        size_t next = 0;
+        const uint64_t end = arrivals.back().first + 100000000;
+        for (uint64_t now = arrivals.front().first; now <= end; now += 100000) {
+            recorder.now_ns = now;
+            while (next < arrivals.size() && arrivals[next].first <= now) {
+                frame.header.timestamp_ns = arrivals[next].second;
+                frame.header.seq = static_cast<uint32_t>(next);
+                buffer.push(frame, now, recorder);
+                if (run.keyframe_every && next % run.keyframe_every == 0) {
+                    // The device's state as of this frame, sent right behind it
+                    keyframe.timestamp_ns = arrivals[next].second;
+                    buffer.push(keyframe, now, recorder);
+                }
+                ++next;
+            }
+            buffer.release(now, recorder);
+        }
+        const JitterBuffer::Stats stats = buffer.getStats();
+        print_jitter_row(run.label, recorder.times, interval_ns, &stats);
+    }
+    return 0;
+}
+
+int bench_shard(const BenchOptions& opt) {
+    size_t max_shards = opt.shards;
+    if (max_shards == 0) {
+        max_shards = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::cout << "shard: " << opt.senders << " saturating publishers (one flow each), "
+              << opt.seconds << " s per run, " << std::thread::hardware_concurrency() << " CPUs" << std::endl;
+
+    // 1, 2, 4, ... shards, ending with max_shards
+    for (size_t shards = 1;; shards = std::min(shards * 2, max_shards)) {
+        unsigned short port = 0;
+        int probe = open_sink(port);
+        if (probe < 0) return 1;
+        close(probe);
+
+        ShardedReceiver receiver(port, shards);
+        receiver.setPinThreads(true);
+        if (!receiver.start()) return 1;
+
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> sent{0};
+        std::vector<std::thread> senders;
+        for (unsigned t = 0; t < opt.senders; ++t) {
+            senders.emplace_back([&, t]() {
+                UDPPublisher publisher("127.0.0.1", port);
+                publisher.setFormat(UDPPublisher::Format::Compact);
+                xbox_udp::InputEventPacket pkt;
+                for (unsigned long r = 0; !stop.load(std::memory_order_relaxed); ++r) {
+                    for (unsigned i = 0; i < 32; ++i) {
+                        make_event(pkt, r, i % 6);
+                        pkt.device_id = static_cast<uint8_t>(t);
+                        publisher.queueEvent(pkt);
+                    }
+                    publisher.flush();
+                }
+                sent += publisher.getStats().datagrams;
+            });
+        }
+
+        const uint64_t before = receiver.getTotalStats().datagrams;
+        std::this_thread::sleep_for(std::chrono::duration<double>(opt.seconds));
+        const uint64_t received = receiver.getTotalStats().datagrams - before;
+        stop = true;
+        for (auto& sender : senders) sender.join();
+
+        std::cout << "  " << std::setw(3) << shards << " shard(s)" << std::fixed << std::setprecision(0)
+                  << std::setw(12) << received / opt.seconds << " pkt/s received"
+                  << std::setw(12) << sent.load() / opt.seconds << " offered  per shard:";
+        for (size_t i = 0; i < shards; ++i) {
+            ShardedReceiver::ShardStats stats = receiver.getShardStats(i);
+            std::cout << " " << stats.datagrams;
+            if (stats.cpu >= 0) std::cout << "@cpu" << stats.cpu;
+        }
+        std::cout << std::endl;
+        receiver.stop();
+        if (shards == max_shards) break;
+    }
+    return 0;
+}
+
+struct SnapshotResult {
+    uint64_t writes = 0;
+    uint64_t reads = 0;
+    uint64_t retries = 0;
+    uint64_t torn = 0;  // Reads that mixed two writes
+    uint64_t reader_cpu_ns = 0;
+};
+
+// The writer sets every axis of write i to i; a consistent read has them all equal
+bool snapshot_consistent(const ControllerSnapshot& snap) {
+    for (unsigned i = 0; i < xbox_udp::STATE_AXIS_COUNT; ++i) {
+        if (snap.axes[i] != snap.axes[0] || snap.normalized[i] != snap.axes[0]) return false;
+    }
+    return true;
+}
+
+void fill_snapshot(ControllerSnapshot& snap, uint64_t i) {
+    snap.updates = i;
+    snap.axis_mask = (1u << xbox_udp::STATE_AXIS_COUNT) - 1;
+    for (unsigned a = 0; a < xbox_udp::STATE_AXIS_COUNT; ++a) {
+        snap.axes[a] = static_cast<int32_t>(i);
+        snap.normalized[a] = static_cast<int32_t>(i);
+    }
+}
+
+// One writer storing as fast as it can, opt.readers threads reading as fast as they can.
+// Write(i) publishes write i; Read(snap) copies the latest and returns its retries.
+template <typename Write, typename Read>
+SnapshotResult run_snapshot(const BenchOptions& opt, Write write, Read read) {
+    SnapshotResult result;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0}, retries{0}, torn{0}, reader_cpu_ns{0};
+    write(0);
+
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < opt.readers; ++r) {
+        readers.emplace_back([&]() {
+            uint64_t n = 0, retry = 0, bad = 0;
+            ControllerSnapshot snap;
+            const uint64_t start = thread_cpu_time_ns();
+            while (!stop.load(std::memory_order_relaxed)) {
+                retry += read(snap);
+                if (!snapshot_consistent(snap)) ++bad;
+                ++n;
+            }
+            reader_cpu_ns += thread_cpu_time_ns() - start;
+            reads += n;
+            retries += retry;
+            torn += bad;
+        });
+    }
+    std::thread writer([&]() {
+        uint64_t i = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            write(++i);
+        }
+        result.writes = i;
+    });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(opt.seconds));
+    stop = true;
+    writer.join();
+    for (auto& reader : readers) reader.join();
+    result.reads = reads;
+    result.retries = retries;
+    result.torn = torn;
+    result.reader_cpu_ns = reader_cpu_ns;
+    return result;
+}
+
+void print_snapshot_row(const char* label, const SnapshotResult& result, const BenchOptions& opt) {
+    const double reads = static_cast<double>(std::max<uint64_t>(result.reads, 1));
+    std::cout << "  " << std::left << std::setw(22) << label << std::right << std::fixed
+              << std::setprecision(0) << std::setw(12) << result.writes / opt.seconds << " writes/s"
+              << std::setw(13) << result.reads / opt.seconds << " reads/s"
+              << std::setprecision(1) << std::setw(8) << result.reader_cpu_ns / reads << " ns CPU/read"
+              << std::setprecision(3) << std::setw(8) << result.retries / reads << " retries/read"
+              << std::setw(6) << result.torn << " torn" << std::endl;
+}
+
+int bench_snapshot(const BenchOptions& opt) {
+    std::cout << "snapshot: 1 writer, " << opt.readers << " readers, " << sizeof(ControllerSnapshot)
+              << "-byte state, " << opt.seconds << " s per run, " << std::thread::hardware_concurrency()
+              << " CPUs" << std::endl;
+
+    // Before: the state behind a mutex
+    {
+        std::mutex mutex;
+        ControllerSnapshot shared;
+        SnapshotResult result = run_snapshot(opt,
+            [&](uint64_t i) {
+                std::lock_guard<std::mutex> lock(mutex);
+                fill_snapshot(shared, i);
+            },
+            [&](ControllerSnapshot& out) -> unsigned {
+                std::lock_guard<std::mutex> lock(mutex);
+                out = shared;
+                return 0;
+            });
+        print_snapshot_row("mutex", result, opt);
+    }
+
+    // After: seqlock, the writer never waits for readers
+    {
+        Seqlock<ControllerSnapshot> seqlock;
+        ControllerSnapshot working;
+        SnapshotResult result = run_snapshot(opt,
+            [&](uint64_t i) {
+                fill_snapshot(working, i);
+                seqlock.store(working);
+            },
+            [&](ControllerSnapshot& out) { return seqlock.load(out); });
+        print_snapshot_row("seqlock", result, opt);
+    }
+
+    // The receiver-side API: StateSnapshots fed with state packets
+    {
+        StateSnapshots snapshots;
+        xbox_udp::StatePacket state;
+        std::memset(&state, 0, sizeof(state));
+        state.magic = xbox_udp::STATE_MAGIC;
+        state.version = xbox_udp::STATE_VERSION;
+        state.axis_mask = (1u << xbox_udp::STATE_AXIS_COUNT) - 1;
+        SnapshotResult result = run_snapshot(opt,
+            [&](uint64_t i) {
+                for (unsigned a = 0; a < xbox_udp::STATE_AXIS_COUNT; ++a) state.axes[a] = static_cast<int32_t>(i);
+                snapshots.apply(state);
+            },
+            [&](ControllerSnapshot& out) -> unsigned {
+                snapshots.read(0, out);
+                return 0;
+            });
+        print_snapshot_row("StateSnapshots::read", result, opt);
+    }
+    return 0;
+}
+
+// Normalized value of axis a of device d at time t: sticks swing at 1-3 Hz, triggers in [0, 1]
+double simulated_axis(unsigned d, unsigned a, uint64_t t_ns) {
+    const double t = static_cast<double>(t_ns) / 1e9;
+    const double phase = d * 0.7 + a * 1.3;
+    const double wave = std::sin(2.0 * M_PI * (1.0 + 0.4 * a) * t + phase);
+    return (a == ABS_Z || a == ABS_RZ) ? 0.5 + 0.5 * wave : wave;
+}
+
+xbox_udp::InputEventPacket make_axis_event(unsigned d, unsigned a, uint64_t ts_ns, double normalized) {
+    xbox_udp::InputEventPacket pkt;
+    pkt.magic = xbox_udp::PACKET_MAGIC;
+    pkt.device_id = static_cast<uint8_t>(d);
+    pkt.type = EV_ABS;
+    pkt.code = static_cast<uint16_t>(a);
+    pkt.value = static_cast<int32_t>(std::lround(normalized * 32767));
+    pkt.normalized = pkt.value / 32767.0;
+    pkt.sec = static_cast<uint32_t>(ts_ns / 1000000000ull);
+    pkt.usec = static_cast<uint32_t>(ts_ns % 1000000000ull / 1000);
+    return pkt;
+}
+
+int bench_predict(const BenchOptions& opt) {
+    // 16 controllers reporting 6 moving axes at 1 kHz; 5% of the reports start a
+    // loss burst of 1-3 reports. A 1 kHz consumer samples each controller 0.8 ms
+    // after each report is due.
+    const unsigned devices = 16;
+    const unsigned axes[] = {ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ};
+    const uint64_t interval_ns = 1000000;
+    const size_t ticks = std::max(1000ul, opt.reports / 10);
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<int> burst(1, 3);
+    std::uniform_int_distribution<uint64_t> transit(50000, 150000);
+
+    std::cout << "predict: " << devices << " controllers x 6 axes, 1 kHz reports, 5% loss bursts of 1-3"
+              << " reports, sampled at 1 kHz (simulated clock)" << std::endl;
+
+    std::vector<int> lost_left(devices, 0);
+    AxisPredictor predictor;
+    // Last received normalized values: what a consumer without prediction sees
+    std::vector<std::array<double, AxisPredictor::AXIS_COUNT>> held(devices);
+    for (auto& values : held) values.fill(0.0);
+    std::array<int32_t, AxisPredictor::AXIS_COUNT> values{};
+    std::array<double, AxisPredictor::AXIS_COUNT> normalized{};
+    double hold_sq = 0, predict_sq = 0, hold_max = 0, predict_max = 0;
+    uint64_t late_samples = 0, predicted_samples = 0, lost_reports = 0;
+
+    for (size_t tick = 1; tick <= ticks; ++tick) {
+        const uint64_t ts = tick * interval_ns;
+        for (unsigned d = 0; d < devices; ++d) {
+            if (lost_left[d] == 0 && tick > 100 && chance(rng) < 0.05) lost_left[d] = burst(rng);
+            const bool lost = lost_left[d] > 0;
+            if (lost) {
+                --lost_left[d];
+                ++lost_reports;
+            } else {
+                const uint64_t arrival = ts + transit(rng);
+                for (unsigned a : axes) {
+                    const xbox_udp::InputEventPacket pkt = make_axis_event(d, a, ts, simulated_axis(d, a, ts));
+                    predictor.observe(pkt, arrival);
+                    held[d][a] = pkt.normalized;
+                }
+            }
+
+            // Score only the samples taken while this report is missing
+            if (!lost) continue;
+            const uint64_t now = ts + 800000;
+            const uint64_t mask = predictor.predict(static_cast<uint8_t>(d), now, values.data(), normalized.data());
+            ++late_samples;
+            if (mask) ++predicted_samples;
+            for (unsigned a : axes) {
+                const double truth = simulated_axis(d, a, now);
+                const double hold_err = held[d][a] - truth;
+                const double predict_err = ((mask >> a) & 1 ? normalized[a] : held[d][a]) - truth;
+                hold_sq += hold_err * hold_err;
+                predict_sq += predict_err * predict_err;
+                hold_max = std::max(hold_max, std::abs(hold_err));
+                predict_max = std::max(predict_max, std::abs(predict_err));
+            }
+        }
+    }
+
+    const double samples = static_cast<double>(std::max<uint64_t>(late_samples, 1) * 6);
+    std::cout << "  " << lost_reports << " reports lost, " << predicted_samples << " of " << late_samples
+              << " late samples predicted" << std::endl;
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "  hold last value          RMS error " << std::sqrt(hold_sq / samples) << ", max "
+              << hold_max << " (normalized units, late samples)" << std::endl;
+    std::cout << "  extrapolate              RMS error " << std::sqrt(predict_sq / samples) << ", max "
+              << predict_max << std::endl;
+
+    // Cost: observe() per event, and a 1 kHz tick calling predict() for every controller while late
+    const size_t reports = std::max(1000ul, opt.reports / 10);
+    AxisPredictor timed;
+    uint64_t start = thread_cpu_time_ns();
+    for (size_t r = 1; r <= reports; ++r) {
+        for (unsigned d = 0; d < devices; ++d) {
+            for (unsigned a : axes) {
+                timed.observe(make_axis_event(d, a, r * interval_ns, simulated_axis(d, a, r * interval_ns)),
+                              r * interval_ns);
+            }
+        }
+    }
+    const double observe_ns = static_cast<double>(thread_cpu_time_ns() - start) / (reports * devices * 6);
+
+    uint64_t sink = 0;
+    start = thread_cpu_time_ns();
+    for (size_t r = 0; r < reports; ++r) {
+        const uint64_t now = (reports + 2) * interval_ns + (r % 1000) * 1000;
+        for (unsigned d = 0; d < devices; ++d) {
+            sink += timed.predict(static_cast<uint8_t>(d), now, values.data(), normalized.data());
+        }
+    }
+    const double tick_ns = static_cast<double>(thread_cpu_time_ns() - start) / reports;
+    std::cout << std::setprecision(1) << "  cost: observe() " << observe_ns << " ns/event (incl. encoding), "
+              << "predict() " << tick_ns / devices << " ns/controller, " << tick_ns / 1000.0
+              << " us per tick for " << devices << " controllers" << std::endl;
+    return sink ? 0 : 1;
+}
+
+// Latency from the writer's send time (looked up by frame seq) to the handler call
+struct DeliveryRecorder : PacketHandler {
+    const std::vector<std::atomic<uint64_t>>* sent_ns = nullptr;
+    LatencyHistogram latency;
+    uint64_t frames = 0;
+    void onFrame(const xbox_udp::FramePacket& frame) {
+        const uint64_t now = JitterBuffer::nowNs();
+        if (frame.header.seq < sent_ns->size()) {
+            latency.record(static_cast<int64_t>(now - (*sent_ns)[frame.header.seq].load(std::memory_order_relaxed)));
+        }
+        ++frames;
+    }
+};
+
+struct DeliveryResult {
+    LatencyHistogram latency;
+    uint64_t frames = 0;
+    uint64_t writer_cpu_ns = 0;
+    uint64_t reader_cpu_ns = 0;
+};
+
+// Publish `count` reports of opt.events_per_report events at 1 kHz from this thread;
+// Reader(recorder, stop) runs on its own thread, blocking until data arrives
+template <typename Queue, typename Flush, typename Reader>
+DeliveryResult run_delivery(const BenchOptions& opt, size_t count, Queue queue, Flush flush, Reader reader) {
+    DeliveryResult result;
+    std::vector<std::atomic<uint64_t>> sent_ns(count);
+    std::atomic<bool> stop{false};
+    DeliveryRecorder recorder;
+    recorder.sent_ns = &sent_ns;
+    uint64_t reader_cpu = 0;
+    std::thread thread([&]() {
+        const uint64_t start = thread_cpu_time_ns();
+        reader(recorder, stop);
+        reader_cpu = thread_cpu_time_ns() - start;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    uint64_t writer_cpu = 0;
+    auto next = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < count; ++r) {
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);
+        const uint64_t start = thread_cpu_time_ns();
+        sent_ns[r].store(JitterBuffer::nowNs(), std::memory_order_relaxed);
+        for (unsigned i = 0; i < opt.events_per_report; ++i) {
+            xbox_udp::InputEventPacket pkt;
+            make_event(pkt, r, i);
+            queue(pkt);
+        }
+        flush();
+        writer_cpu += thread_cpu_time_ns() - start;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    stop = true;
+    thread.join();
+
+    result.latency = recorder.latency;
+    result.frames = recorder.frames;
+    result.writer_cpu_ns = writer_cpu;
+    result.reader_cpu_ns = reader_cpu;
+    return result;
+}
+
+void print_delivery_row(const char* label, const DeliveryResult& result, size_t count) {
+    const double reports = static_cast<double>(std::max<size_t>(count, 1));
+    std::cout << "  " << std::left << std::setw(14) << label << std::right << std::fixed << std::setprecision(1)
+              << " latency us: p50 " << std::setw(6) << result.latency.percentile(50) / 1000.0
+              << " p99 " << std::setw(6) << result.latency.percentile(99) / 1000.0
+              << " p99.9 " << std::setw(7) << result.latency.percentile(99.9) / 1000.0
+              << " max " << std::setw(7) << result.latency.max() / 1000.0
+              << " | CPU/report: writer " << std::setw(6) << result.writer_cpu_ns / reports / 1000.0
+              << " us, reader " << std::setw(6) << result.reader_cpu_ns / reports / 1000.0 << " us ("
+              << result.frames << "/" << count << " received)" << std::endl;
+}
+
+// run_delivery() through a UDPPublisher (frame format) and a UDPReceiverT blocking
+// in poll(): over loopback UDP, or the Unix datagram socket `unix_endpoint`
+bool run_socket_delivery(const BenchOptions& opt, size_t count, const std::string& unix_endpoint,
+                         DeliveryResult& result) {
+    unsigned short port = 0;
+    if (unix_endpoint.empty()) {
+        int probe = open_sink(port);
+        if (probe < 0) return false;
+        close(probe);
+    }
+    UDPReceiverT<DeliveryRecorder> receiver(port, 0);
+    if (!unix_endpoint.empty()) receiver.setUnixSocket(unix_endpoint);
+    if (!receiver.bind()) return false;
+    UDPPublisher publisher(unix_endpoint.empty() ? "127.0.0.1" : unix_endpoint, port);
+    if (!publisher.isConnected()) return false;
+    publisher.setFormat(UDPPublisher::Format::Frame);
+    result = run_delivery(opt, count,
+        [&](const xbox_udp::InputEventPacket& pkt) { publisher.queueEvent(pkt); },
+        [&]() { publisher.flush(); },
+        [&](DeliveryRecorder& recorder, std::atomic<bool>& stop) {
+            receiver.handler().sent_ns = recorder.sent_ns;
+            while (!stop.load()) receiver.poll(10);
+            recorder.latency = receiver.handler().latency;
+            recorder.frames = receiver.handler().frames;
+        });
+    return true;
+}
+
+int bench_shm(const BenchOptions& opt) {
+    const size_t count = static_cast<size_t>(opt.seconds * 1000);
+    std::cout << "shm: " << count << " reports of " << opt.events_per_report << " events at 1 kHz,"
+              << " one frame each, to a blocking reader thread (" << std::thread::hardware_concurrency()
+              << " CPUs)" << std::endl;
+
+    // Before: loopback UDP, frame format, receiver blocking in poll()
+    DeliveryResult udp;
+    if (!run_socket_delivery(opt, count, "", udp)) return 1;
+    print_delivery_row("udp loopback", udp, count);
+
+    // After: shared-memory ring, reader blocking on the futex
+    {
+        const std::string name = "xbox_udp_bench_" + std::to_string(getpid());
+        ShmPublisher publisher(name, 4096);
+        if (!publisher.isOpen()) return 1;
+        ShmReader reader(name);
+        if (!reader.open()) return 1;
+        DeliveryResult result = run_delivery(opt, count,
+            [&](const xbox_udp::InputEventPacket& pkt) { publisher.queueEvent(pkt); },
+            [&]() { publisher.flush(); },
+            [&](DeliveryRecorder& recorder, std::atomic<bool>& stop) {
+                while (!stop.load()) reader.poll(recorder, 10);
+            });
+        print_delivery_row("shm ring", result, count);
+        std::cout << "  shm: " << publisher.getStats().wakeups << " futex wakeups, " << reader.getStats().waits
+                  << " waits, " << reader.getStats().lost << " lost" << std::endl;
+    }
+    return 0;
+}
+
+int bench_unix(const BenchOptions& opt) {
+    const size_t count = static_cast<size_t>(opt.seconds * 1000);
+    std::cout << "unix: " << count << " reports of " << opt.events_per_report << " events at 1 kHz,"
+              << " one frame each, to a blocking reader thread (" << std::thread::hardware_concurrency()
+              << " CPUs)" << std::endl;
+
+    const std::string pid = std::to_string(getpid());
+    const struct {
+        const char* label;
+        std::string endpoint;
+    } transports[] = {
+        {"udp loopback", ""},
+        {"unix path", "unix:/tmp/xbox_udp_bench_" + pid + ".sock"},
+        {"unix abstract", "unix:@xbox_udp_bench_" + pid},
+    };
+    for (const auto& transport : transports) {
+        DeliveryResult result;
+        if (!run_socket_delivery(opt, count, transport.endpoint, result)) return 1;
+        print_delivery_row(transport.label, result, count);
+    }
+    return 0;
+}
+
+int bench_gso(const BenchOptions& opt) {
+    unsigned short port = 0;
+    int sink = open_sink(port);
+    if (sink < 0) return 1;
+    std::cout << "gso: bursts of state packets (" << sizeof(xbox_udp::StatePacket) << " bytes, one per device)"
+              << " for " << opt.seconds << " s each -> 127.0.0.1:" << port << std::endl;
+
+    xbox_udp::StatePacket state;
+    std::memset(&state, 0, sizeof(state));
+    state.magic = xbox_udp::STATE_MAGIC;
+    state.version = xbox_udp::STATE_VERSION;
+    for (unsigned burst : {1u, 4u, 16u, 64u}) {
+        for (bool segmentation : {false, true}) {
+            UDPPublisher publisher("127.0.0.1", port);
+            if (!publisher.isConnected() || (segmentation && !publisher.setSegmentation(true))) {
+                close(sink);
+                return 1;
+            }
+            uint64_t bursts = 0;
+            const uint64_t start = thread_cpu_time_ns();
+            const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(opt.seconds);
+            while (std::chrono::steady_clock::now() < end) {
+                for (unsigned d = 0; d < burst; ++d) {
+                    state.device_id = static_cast<uint8_t>(d);
+                    publisher.queueState(state);
+                }
+                publisher.flush();
+                ++bursts;
+            }
+            const uint64_t cpu_ns = thread_cpu_time_ns() - start;
+            const UDPPublisher::Stats& stats = publisher.getStats();
+            const std::string label = std::to_string(burst) + (segmentation ? " x gso" : " x sendmmsg");
+            std::cout << "  " << std::setw(14) << std::left << label << std::right << std::fixed
+                      << std::setprecision(0) << std::setw(10) << stats.datagrams * 1e9 / std::max<uint64_t>(cpu_ns, 1)
+                      << " datagrams/s/core" << std::setprecision(1) << std::setw(8)
+                      << static_cast<double>(cpu_ns) / std::max<uint64_t>(stats.datagrams, 1) << " ns CPU/datagram"
+                      << std::setprecision(2) << std::setw(8) << static_cast<double>(stats.syscalls) / std::max<uint64_t>(bursts, 1)
+                      << " syscalls/burst  (" << stats.segmented << " segmented, " << stats.errors << " errors)"
+                      << std::endl;
+        }
+    }
+    close(sink);
+    return 0;
+}
+
+// Syscalls and CPU of the event loop thread, per report
+struct LoopCost {
+    uint64_t syscalls = 0;
+    uint64_t cpu_ns = 0;
+};
+
+// Turn one read of the simulated device into packets, flushing at SYN_REPORT
+void bridge_events(UDPPublisher& publisher, const struct input_event* events, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const struct input_event& ev = events[i];
+        if (ev.type == EV_SYN) {
+            if (ev.code == SYN_REPORT) publisher.flush();
+            continue;
+        }
+        xbox_udp::InputEventPacket pkt;
+        pkt.magic = xbox_udp::PACKET_MAGIC;
+        pkt.device_id = 0;
+        pkt.type = ev.type;
+        pkt.code = ev.code;
+        pkt.value = ev.value;
+        pkt.normalized = ev.value / 32768.0;
+        pkt.sec = static_cast<uint32_t>(ev.input_event_sec);
+        pkt.usec = static_cast<uint32_t>(ev.input_event_usec);
+        publisher.queueEvent(pkt);
+    }
+    publisher.flush();
+}
+
+// run_delivery() with joystick's loop in the middle: the reports go into a pipe
+// (the simulated evdev device), `loop(publisher, device_fd, control_fd, stop, cost)`
+// forwards them as frames to a UDPReceiverT on another thread. control_fd stands
+// in for the vibration socket and never receives anything.
+template <typename Loop>
+bool run_bridge(const BenchOptions& opt, size_t count, Loop loop, DeliveryResult& result, LoopCost& cost) {
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    unsigned short control_port = 0;
+    int control = open_sink(control_port);
+    unsigned short port = 0;
+    int probe = open_sink(port);
+    if (control < 0 || probe < 0) return false;
+    close(probe);
+
+    UDPReceiverT<DeliveryRecorder> receiver(port, 0);
+    UDPPublisher publisher("127.0.0.1", port);
+    if (!receiver.bind() || !publisher.isConnected()) return false;
+    publisher.setFormat(UDPPublisher::Format::Frame);
+
+    std::vector<struct input_event> report;
+    result = run_delivery(opt, count,
+        [&](const xbox_udp::InputEventPacket& pkt) {
+            struct input_event ev;
+            std::memset(&ev, 0, sizeof(ev));
+            ev.type = pkt.type;
+            ev.code = pkt.code;
+            ev.value = pkt.value;
+            report.push_back(ev);
+        },
+        [&]() {
+            struct input_event syn;
+            std::memset(&syn, 0, sizeof(syn));
+            syn.type = EV_SYN;
+            syn.code = SYN_REPORT;
+            report.push_back(syn);
+            if (write(fds[1], report.data(), report.size() * sizeof(report[0])) < 0) {
+                std::cerr << "write: " << std::strerror(errno) << std::endl;
+            }
+            report.clear();
+        },
+        [&](DeliveryRecorder& recorder, std::atomic<bool>& stop) {
+            receiver.handler().sent_ns = recorder.sent_ns;
+            std::atomic<bool> receiver_stop{false};
+            std::thread thread([&]() {
+                while (!receiver_stop.load()) receiver.poll(10);
+            });
+            loop(publisher, fds[0], control, stop, cost);
+            receiver_stop = true;
+            thread.join();
+            recorder.latency = receiver.handler().latency;
+            recorder.frames = receiver.handler().frames;
+        });
+    // The loop runs on run_delivery()'s reader thread: its CPU is the reader column
+    cost.cpu_ns = result.reader_cpu_ns;
+    close(fds[0]);
+    close(fds[1]);
+    close(control);
+    return true;
+}
+
+void print_loop_row(const char* label, const LoopCost& cost, size_t count) {
+    const double reports = static_cast<double>(std::max<size_t>(count, 1));
+    std::cout << "  " << std::left << std::setw(14) << label << std::right << std::fixed << std::setprecision(2)
+              << " loop: " << std::setw(6) << cost.syscalls / reports << " syscalls/report, "
+              << std::setprecision(1) << std::setw(6) << cost.cpu_ns / reports / 1000.0 << " us CPU/report"
+              << std::endl;
+}
+
+int bench_uring(const BenchOptions& opt) {
+#ifdef XBOX_HAVE_IO_URING
+    const size_t count = static_cast<size_t>(opt.seconds * 1000);
+    std::cout << "uring: " << count << " reports of " << opt.events_per_report << " events at 1 kHz"
+              << " from a simulated device, forwarded as frames over loopback UDP ("
+              << std::thread::hardware_concurrency() << " CPUs)" << std::endl;
+
+    // Before: joystick's poll() loop, libevdev-style reads until EAGAIN
+    DeliveryResult before;
+    LoopCost before_cost;
+    bool ok = run_bridge(opt, count,
+        [](UDPPublisher& publisher, int device, int control, std::atomic<bool>& stop, LoopCost& cost) {
+            std::array<struct input_event, 64> events;
+            const uint64_t sends = publisher.getStats().syscalls;
+            while (!stop.load()) {
+                struct pollfd vibration = {control, POLLIN, 0};
+                poll(&vibration, 1, 0);  // receiver.poll(0)
+                struct pollfd pfd = {device, POLLIN, 0};
+                ++cost.syscalls;
+                if (poll(&pfd, 1, 10) <= 0) {
+                    ++cost.syscalls;
+                    continue;
+                }
+                ssize_t n;
+                do {
+                    n = read(device, events.data(), sizeof(events));
+                    ++cost.syscalls;
+                    if (n > 0) bridge_events(publisher, events.data(), static_cast<size_t>(n) / sizeof(events[0]));
+                } while (n > 0);
+                ++cost.syscalls;
+            }
+            cost.syscalls += publisher.getStats().syscalls - sends;
+        },
+        before, before_cost);
+    if (!ok) return 1;
+    print_delivery_row("poll loop", before, count);
+
+    // After: one io_uring_enter() per wakeup, sends queued on the ring
+    DeliveryResult after;
+    LoopCost after_cost;
+    ok = run_bridge(opt, count,
+        [](UDPPublisher& publisher, int device, int control, std::atomic<bool>& stop, LoopCost& cost) {
+            IoRing ring(64);
+            if (!ring.isOpen()) return;
+            IoRingSender sender(ring);
+            publisher.setSender([&sender](int sock, struct mmsghdr* msgs, unsigned n, int flags) {
+                return sender.send(sock, msgs, n, flags);
+            });
+            constexpr uint64_t CONTROL = 1;
+            std::array<struct input_event, 64> events;
+            ring.pollRead(device, events.data(), sizeof(events), 0);
+            ring.pollMultishot(control, CONTROL);
+            while (!stop.load()) {
+                if (!ring.submit(1 + sender.inFlight(), 10)) break;
+                ring.forEachCompletion([&](const struct io_uring_cqe& cqe) {
+                    if (sender.complete(cqe) || cqe.user_data == CONTROL) return;
+                    if (cqe.user_data & IoRing::POLL_LINK) return;
+                    if (cqe.res > 0) {
+                        bridge_events(publisher, events.data(), static_cast<size_t>(cqe.res) / sizeof(events[0]));
+                    }
+                    ring.pollRead(device, events.data(), sizeof(events), 0);
+                });
+            }
+            publisher.setSender(nullptr);
+            cost.syscalls = ring.getStats().enters;
+        },
+        after, after_cost);
+    if (!ok) return 1;
+    print_delivery_row("io_uring loop", after, count);
+    print_loop_row("poll loop", before_cost, count);
+    print_loop_row("io_uring loop", after_cost, count);
+    return 0;
+#else
+    (void)opt;
+    std::cerr << "uring: built without io_uring (XBOX_IO_URING=OFF or no <linux/io_uring.h>)" << std::endl;
+    return 1;
+#endif
+}
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [batch|fanout|recv|shard|snapshot|handler|jitter|predict|shm|unix|gso|uring] [--reports N] [--events N]"
+              << " [--seconds S] [--shards N] [--senders N] [--readers N]" << std::endl;
+    std::cerr << "  batch      send() per event vs. one sendmmsg() per report" << std::endl;
+    std::cerr << "  fanout     1..32 destinations: publisher per destination vs. encode once" << std::endl;
+    std::cerr << "  recv       Max receive rate: recv() per wakeup vs. recvmmsg() drain" << std::endl;
+    std::cerr << "  shard      SO_REUSEPORT sharded receiver, 1..N shards" << std::endl;
+    std::cerr << "  snapshot   Latest-state reads, 1 writer and N readers: seqlock vs. mutex" << std::endl;
+    std::cerr << "  handler    Receive CPU per packet: std::function callbacks vs. inlined handler" << std::endl;
+    std::cerr << "  jitter     Playout smoothness of clumped arrivals with and without a jitter buffer"
+              << std::endl;
+    std::cerr << "  predict    Stick error during packet loss: hold vs. extrapolate, and predictor cost"
+              << std::endl;
+    std::cerr << "  shm        1 kHz reports to a blocking reader: loopback UDP vs. shared-memory ring"
+              << std::endl;
+    std::cerr << "  unix       1 kHz reports to a blocking reader: loopback UDP vs. Unix datagram socket"
+              << std::endl;
+    std::cerr << "  gso        Datagrams/s per core for keyframe bursts: sendmmsg() vs. UDP_SEGMENT" << std::endl;
+    std::cerr << "  uring      Device-to-socket event loop at 1 kHz: poll() + read() + sendmmsg() vs. io_uring"
+              << std::endl;
+    std::cerr << "  --reports  Number of reports to publish (default: 200000)" << std::endl;
+    std::cerr << "  --events   Events per report (default: 3)" << std::endl;
+    std::cerr << "  --seconds  Duration of each recv/shard/snapshot/shm/unix/gso/uring run (default: 2)" << std::endl;
+    std::cerr << "  --shards   Maximum shards (default: number of CPUs)" << std::endl;
+    std::cerr << "  --senders  Publisher threads for shard (default: 8)" << std::endl;
+    std::cerr << "  --readers  Reader threads for snapshot (default: 8)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions opt;
+    std::string name = "batch";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--reports" && i + 1 < argc) {
+            opt.reports = std::stoul(argv[++i]);
+        } else if (arg == "--events" && i + 1 < argc) {
+            opt.events_per_report = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--shards" && i + 1 < argc) {
+            opt.shards = std::stoul(argv[++i]);
+        } else if (arg == "--readers" && i + 1 < argc) {
+            opt.readers = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--senders" && i + 1 < argc) {
+            opt.senders = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--seconds" && i + 1 < argc) {
+            opt.seconds = std::stod(argv[++i]);
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            name = arg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.reports == 0 || opt.events_per_report == 0 || !(opt.seconds > 0.0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (name == "batch") return bench_batch(opt);
+    if (name == "fanout") return bench_fanout(opt);
+    if (name == "recv") return bench_recv(opt);
+    if (name == "shard") return bench_shard(opt);
+    if (name == "snapshot") return bench_snapshot(opt);
+    if (name == "handler") return bench_handler(opt);
+    if (name == "jitter") return bench_jitter(opt);
+    if (name == "predict") return bench_predict(opt);
+    if (name == "shm") return bench_shm(opt);
+    if (name == "unix") return bench_unix(opt);
+    if (name == "gso") return bench_gso(opt);
+    if (name == "uring") return bench_uring(opt);
+
+    usage(argv[0]);
+    return 1;
+}
@@ -3,40 +3,385 @@
  */
 
 #include "udp_publisher.hpp"
+#include "socket_util.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
 #include <iostream>
 
 UDPPublisher::UDPPublisher(const std::string& dest_addr, unsigned short port)
-    : dest_addr_(dest_addr), port_(port), sock_(-1) {
+    : UDPPublisher(dest_addr, port, MulticastOptions()) {
+}
+
+UDPPublisher::UDPPublisher(const std::string& dest_addr, unsigned short port,
+                           const MulticastOptions& multicast)
+    : sock_(-1), dest_addr_(dest_addr), port_(port), multicast_options_(multicast) {
+    
+    socket_util::Address addr;
+    if (!socket_util::parseEndpoint(dest_addr, port, addr)) {
+        return;
+    }
+    family_ = addr.family();
     
-    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sock_ = socket(family_, SOCK_DGRAM, 0);
     if (sock_ < 0) {
         std::cerr << "socket: " << std::strerror(errno) << std::endl;
         return;
     }
     
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    if (inet_pton(AF_INET, dest_addr.c_str(), &addr.sin_addr) <= 0) {
-        std::cerr << "inet_pton " << dest_addr << ": invalid address" << std::endl;
-        close(sock_);
-        sock_ = -1;
-        return;
+    if (family_ == AF_UNIX) {
+        // Unconnected: every send looks the path up, so a restarted receiver
+        // (a new socket at the same path) is found again
+        send_flags_ = MSG_DONTWAIT;
+    } else {
+        multicast_ = socket_util::isMulticast(addr.in.sin_addr);
+        if (multicast_ && !applyMulticastOptions(multicast)) {
+            close(sock_);
+            sock_ = -1;
+            return;
+        }
+        
+        if (connect(sock_, &addr.sa, addr.len) < 0) {
+            std::cerr << "connect: " << std::strerror(errno) << std::endl;
+            close(sock_);
+            sock_ = -1;
+            return;
+        }
+        connected_ = true;
+    }
+    dests_.push_back(addr);
+
+    streams_.emplace_back(new Stream());
+    iovecs_.reserve(MAX_BATCH);
+    msgs_.reserve(MAX_BATCH);
+}
+
+UDPPublisher::Stream::Stream() {
+    queue.reserve(MAX_BATCH);
+    frames.reserve(MAX_BATCH);
+    states.reserve(MAX_BATCH);
+    open_frame.fill(-1);
+    next_seq.fill(0);
+}
+
+bool UDPPublisher::addDestination(const std::string& dest_addr, unsigned short port) {
+    if (sock_ < 0) return false;
+
+    socket_util::Address addr;
+    if (!socket_util::parseEndpoint(dest_addr, port, addr)) {
+        return false;
+    }
+    if (addr.family() != family_) {
+        std::cerr << "destination " << dest_addr << ": can't mix Unix and IPv4 destinations" << std::endl;
+        return false;
+    }
+    for (const auto& dest : dests_) {
+        if (dest == addr) {
+            return true;
+        }
+    }
+    if (family_ == AF_INET && socket_util::isMulticast(addr.in.sin_addr) && !multicast_) {
+        if (!applyMulticastOptions(multicast_options_)) {
+            return false;
+        }
+        multicast_ = true;
+    }
+
+    // Queued packets were meant for the current set of destinations
+    flush();
+    if (!disconnect()) {
+        return false;
+    }
+    dests_.push_back(addr);
+    return true;
+}
+
+bool UDPPublisher::disconnect() {
+    if (!connected_) return true;
+
+    // Dissolve the association so sendmmsg() can address each message
+    struct sockaddr unspec;
+    std::memset(&unspec, 0, sizeof(unspec));
+    unspec.sa_family = AF_UNSPEC;
+    if (connect(sock_, &unspec, sizeof(unspec)) < 0) {
+        std::cerr << "connect AF_UNSPEC: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    connected_ = false;
+    return true;
+}
+
+bool UDPPublisher::handleSubscribe(const xbox_udp::SubscribePacket& pkt, const struct sockaddr_in& from) {
+    if (sock_ < 0 || family_ != AF_INET) return false;
+    if (pkt.magic != xbox_udp::SUBSCRIBE_MAGIC || pkt.version != xbox_udp::SUBSCRIBE_VERSION) {
+        return false;
+    }
+
+    // Deliver to the source of the registration only, so it can't aim the stream
+    // at a third party
+    const struct sockaddr_in& addr = from;
+    auto it = std::find_if(subscribers_.begin(), subscribers_.end(), [&addr](const Subscriber& sub) {
+        return sub.addr.sin_addr.s_addr == addr.sin_addr.s_addr && sub.addr.sin_port == addr.sin_port;
+    });
+
+    if (pkt.flags & xbox_udp::SUBSCRIBE_CANCEL) {
+        if (it != subscribers_.end()) {
+            subscribers_.erase(it);
+            dropUnusedStreams();
+        }
+        return true;
+    }
+
+    // Packets already queued predate the subscription (or its new filter)
+    flush();
+
+    const Clock::time_point now = Clock::now();
+    if (it == subscribers_.end()) {
+        // A fixed destination already gets every packet; registering it too would
+        // deliver everything twice
+        for (const auto& dest : dests_) {
+            if (dest.in.sin_addr.s_addr == addr.sin_addr.s_addr && dest.in.sin_port == addr.sin_port) {
+                return true;
+            }
+        }
+        if (subscribers_.size() >= MAX_SUBSCRIBERS) {
+            std::cerr << "Subscriber " << inet_ntoa(addr.sin_addr) << ":" << ntohs(addr.sin_port)
+                      << " rejected: " << MAX_SUBSCRIBERS << " subscribers registered" << std::endl;
+            return false;
+        }
+    }
+
+    // Full-rate subscribers share the stream encoded for their filter
+    const bool filtered = (pkt.flags & xbox_udp::SUBSCRIBE_FILTER) != 0;
+    Stream* stream = nullptr;
+    if (pkt.max_rate_hz == 0) {
+        stream = filtered ? findStream(pkt.filter) : streams_[0].get();
+        if (!stream) {
+            std::cerr << "Subscriber " << inet_ntoa(addr.sin_addr) << ":" << ntohs(addr.sin_port)
+                      << " rejected: " << MAX_FILTERED_STREAMS << " distinct filters in use" << std::endl;
+            return false;
+        }
+    }
+
+    if (it == subscribers_.end()) {
+        if (!disconnect()) {
+            dropUnusedStreams();
+            return false;
+        }
+        subscribers_.emplace_back();
+        it = subscribers_.end() - 1;
+        it->addr = addr;
+        it->next_due = now;
+    }
+
+    const uint32_t lease_ms = std::max(xbox_udp::MIN_LEASE_MS, std::min(xbox_udp::MAX_LEASE_MS,
+        pkt.lease_ms != 0 ? pkt.lease_ms : xbox_udp::DEFAULT_LEASE_MS));
+    it->max_rate_hz = pkt.max_rate_hz;
+    it->expires = now + std::chrono::milliseconds(lease_ms);
+    it->filtered = filtered;
+    if (it->filtered) {
+        it->filter = pkt.filter;
+    }
+    it->stream = stream;
+    dropUnusedStreams();
+    // Each refresh doubles as a keyframe request for rate-limited subscribers
+    it->resend_all = true;
+    return true;
+}
+
+UDPPublisher::Stream* UDPPublisher::findStream(const xbox_udp::SubscribeFilter& filter) {
+    for (auto& stream : streams_) {
+        if (stream->filtered && std::memcmp(&stream->filter, &filter, sizeof(filter)) == 0) {
+            return stream.get();
+        }
+    }
+    // streams_[0] is the unfiltered one
+    if (streams_.size() > MAX_FILTERED_STREAMS) {
+        return nullptr;
+    }
+    streams_.emplace_back(new Stream());
+    streams_.back()->filtered = true;
+    streams_.back()->filter = filter;
+    return streams_.back().get();
+}
+
+void UDPPublisher::dropUnusedStreams() {
+    // streams_[0] always stays: it feeds the destinations
+    for (size_t i = streams_.size(); i-- > 1;) {
+        const Stream* stream = streams_[i].get();
+        bool used = std::any_of(subscribers_.begin(), subscribers_.end(),
+                                [stream](const Subscriber& sub) { return sub.stream == stream; });
+        if (!used) {
+            streams_.erase(streams_.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+    }
+}
+
+void UDPPublisher::publishState(const xbox_udp::StatePacket& state) {
+    LatestState& latest = latest_states_[state.device_id];
+    latest.state = state;
+    ++latest.version;
+}
+
+bool UDPPublisher::snapshotAllowed(const struct sockaddr_in& addr, uint8_t device_id, Clock::time_point now) {
+    const Clock::duration interval = std::chrono::milliseconds(SNAPSHOT_INTERVAL_MS);
+    SnapshotReply* oldest = nullptr;
+    for (SnapshotReply& reply : snapshot_replies_) {
+        if (reply.addr.sin_addr.s_addr == addr.sin_addr.s_addr && reply.addr.sin_port == addr.sin_port &&
+            reply.device_id == device_id) {
+            if (now - reply.sent < interval) return false;
+            reply.sent = now;
+            return true;
+        }
+        if (!oldest || reply.sent < oldest->sent) oldest = &reply;
+    }
+    if (snapshot_replies_.size() < MAX_SNAPSHOT_SOURCES) {
+        snapshot_replies_.push_back(SnapshotReply{addr, device_id, now});
+        return true;
+    }
+    // Every slot busy within the interval: a flood of (spoofed) sources, refuse
+    if (now - oldest->sent < interval) return false;
+    *oldest = SnapshotReply{addr, device_id, now};
+    return true;
+}
+
+bool UDPPublisher::sendSnapshot(const xbox_udp::StatePacket& state, const xbox_udp::StateRequestPacket& request,
+                                const struct sockaddr_in& from) {
+    if (sock_ < 0 || family_ != AF_INET) return false;
+    if (request.magic != xbox_udp::STATE_REQUEST_MAGIC || request.version != xbox_udp::STATE_REQUEST_VERSION) {
+        return false;
+    }
+
+    // Always reply to the source of the request
+    const struct sockaddr_in& addr = from;
+    xbox_udp::StatePacket snapshot = state;
+    snapshot.flags |= xbox_udp::STATE_SNAPSHOT;
+    auto sub = std::find_if(subscribers_.begin(), subscribers_.end(), [&addr](const Subscriber& s) {
+        return s.addr.sin_addr.s_addr == addr.sin_addr.s_addr && s.addr.sin_port == addr.sin_port;
+    });
+    if (sub == subscribers_.end()) {
+        if (!snapshotAllowed(addr, state.device_id, Clock::now())) return false;
+    } else if (sub->filtered) {
+        if (!xbox_udp::testStateBit(sub->filter.devices, state.device_id)) return true;
+        xbox_udp::filterState(sub->filter, snapshot);
+    }
+
+    // The address overrides the connected destination, so this works in every mode
+    ssize_t sent = sendto(sock_, &snapshot, sizeof(snapshot), 0,
+                          reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr));
+    ++stats_.syscalls;
+    if (sent != static_cast<ssize_t>(sizeof(snapshot))) {
+        ++stats_.errors;
+        std::cerr << "sendto snapshot: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    ++stats_.datagrams;
+    return true;
+}
+
+int UDPPublisher::subscriberTimeoutMs() const {
+    const Clock::time_point now = Clock::now();
+    int timeout = -1;
+    for (const auto& sub : subscribers_) {
+        if (sub.max_rate_hz == 0) continue;
+
+        bool pending = sub.resend_all && !latest_states_.empty();
+        for (auto it = latest_states_.begin(); !pending && it != latest_states_.end(); ++it) {
+            auto sent = sub.sent.find(it->first);
+            pending = sent == sub.sent.end() || sent->second.version != it->second.version;
+        }
+        if (!pending) continue;
+
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(sub.next_due - now).count();
+        const int ms = wait > 0 ? static_cast<int>(wait) : 0;
+        if (timeout < 0 || ms < timeout) {
+            timeout = ms;
+        }
+    }
+    return timeout;
+}
+
+bool UDPPublisher::stateDue(Subscriber& sub, uint8_t device_id, const LatestState& latest,
+                            xbox_udp::StatePacket& out) {
+    SentState& sent = sub.sent[device_id];
+    if (!sub.resend_all && sent.version == latest.version) return false;
+    sent.version = latest.version;
+
+    out = latest.state;
+    if (sub.filtered) {
+        if (!xbox_udp::testStateBit(sub.filter.devices, device_id)) return false;
+        xbox_udp::filterState(sub.filter, out);
+        // Changes outside the filter don't wake the subscriber
+        if (!sub.resend_all &&
+            std::memcmp(out.key_mask, sent.last.key_mask, sizeof(out.key_mask)) == 0 &&
+            std::memcmp(out.buttons, sent.last.buttons, sizeof(out.buttons)) == 0 &&
+            out.axis_mask == sent.last.axis_mask && out.normalized_mask == sent.last.normalized_mask &&
+            std::memcmp(out.axes, sent.last.axes, sizeof(out.axes)) == 0) {
+            return false;
+        }
+        sent.last = out;
+    }
+    out.seq = sent.seq++;
+    return true;
+}
+
+void UDPPublisher::queueSubscriberStates(Clock::time_point now) {
+    const size_t before = subscribers_.size();
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(),
+        [now](const Subscriber& sub) { return sub.expires <= now; }), subscribers_.end());
+    if (subscribers_.size() != before) {
+        dropUnusedStreams();
+    }
+
+    for (auto& sub : subscribers_) {
+        if (sub.max_rate_hz == 0 || sub.next_due > now) continue;
+
+        // Coalesce: only the newest state of each device that changed since the last delivery
+        bool sent_any = false;
+        for (const auto& [device_id, latest] : latest_states_) {
+            xbox_udp::StatePacket state;
+            if (!stateDue(sub, device_id, latest, state)) continue;
+            sub_states_.push_back(state);
+            sub_targets_.push_back(sub.addr);
+            sent_any = true;
+        }
+        sub.resend_all = false;
+        if (sent_any) {
+            sub.next_due = now + std::chrono::microseconds(1000000 / sub.max_rate_hz);
+        }
+    }
+}
+
+bool UDPPublisher::applyMulticastOptions(const MulticastOptions& multicast) {
+    int ttl = multicast.ttl;
+    if (setsockopt(sock_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+        std::cerr << "setsockopt IP_MULTICAST_TTL: " << std::strerror(errno) << std::endl;
+        return false;
     }
     
-    if (connect(sock_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        std::cerr << "connect: " << std::strerror(errno) << std::endl;
-        close(sock_);
-        sock_ = -1;
-        return;
+    int loop = multicast.loopback ? 1 : 0;
+    if (setsockopt(sock_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+        std::cerr << "setsockopt IP_MULTICAST_LOOP: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    
+    if (!multicast.interface.empty()) {
+        struct ip_mreqn mreq;
+        if (!socket_util::resolveInterface(multicast.interface, mreq)) {
+            return false;
+        }
+        if (setsockopt(sock_, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) < 0) {
+            std::cerr << "setsockopt IP_MULTICAST_IF " << multicast.interface << ": "
+                      << std::strerror(errno) << std::endl;
+            return false;
+        }
     }
+    return true;
 }
 
 UDPPublisher::~UDPPublisher() {
@@ -47,11 +392,390 @@ UDPPublisher::~UDPPublisher() {
 
 bool UDPPublisher::sendEvent(const xbox_udp::InputEventPacket& pkt) {
     if (sock_ < 0) return false;
+
+    if (!connected_) {
+        // Keep order with anything queued, then one message per receiver whose stream passes it
+        bool ok = flush();
+        iovecs_.clear();
+        iovecs_.push_back({const_cast<xbox_udp::InputEventPacket*>(&pkt), sizeof(pkt)});
+        for (auto& stream : streams_) {
+            const bool passes = stream->passes(pkt.device_id, pkt.type, pkt.code);
+            stream->first_iov = 0;
+            stream->iov_count = passes ? 1 : 0;
+        }
+        return submit() && ok;
+    }
     
-    ssize_t sent = send(sock_, &pkt, sizeof(pkt), 0);
+    ssize_t sent = send(sock_, &pkt, sizeof(pkt), send_flags_);
+    ++stats_.syscalls;
     if (sent != static_cast<ssize_t>(sizeof(pkt))) {
+        ++stats_.errors;
         std::cerr << "send: " << std::strerror(errno) << std::endl;
         return false;
     }
+    ++stats_.datagrams;
     return true;
 }
+
+size_t UDPPublisher::pending() const {
+    size_t count = 0;
+    for (const auto& stream : streams_) {
+        count += stream->pending();
+    }
+    return count;
+}
+
+bool UDPPublisher::queueEvent(const xbox_udp::InputEventPacket& pkt) {
+    if (sock_ < 0) return false;
+
+    bool ok = true;
+    for (auto& stream : streams_) {
+        // Subscriber filters are evaluated before anything is encoded
+        if (!stream->passes(pkt.device_id, pkt.type, pkt.code)) continue;
+        if (stream->pending() >= MAX_BATCH && startsPacket(*stream, pkt.device_id)) {
+            ok = flush() && ok;
+        }
+        encodeEvent(*stream, pkt);
+    }
+    return ok;
+}
+
+bool UDPPublisher::startsPacket(const Stream& stream, uint8_t device_id) const {
+    // Format::Compact never reuses a frame, so every event travels as a one-entry frame.
+    // An oversized report closes its frame and continues in a new one.
+    if (format_ != Format::Frame) return true;
+    const int16_t index = stream.open_frame[device_id];
+    return index < 0 || stream.frames[index].header.count >= xbox_udp::MAX_FRAME_ENTRIES;
+}
+
+void UDPPublisher::encodeEvent(Stream& stream, const xbox_udp::InputEventPacket& pkt) {
+    if (format_ == Format::Event) {
+        stream.queue.push_back(pkt);
+        return;
+    }
+
+    // Frame formats: append to the device's open frame, starting a new one when needed
+    int16_t index = stream.open_frame[pkt.device_id];
+    if (startsPacket(stream, pkt.device_id)) {
+        index = static_cast<int16_t>(stream.frames.size());
+        stream.frames.emplace_back();
+        xbox_udp::FrameHeader& header = stream.frames.back().header;
+        header.magic = xbox_udp::FRAME_MAGIC;
+        header.version = xbox_udp::FRAME_VERSION;
+        header.device_id = pkt.device_id;
+        header.count = 0;
+        header.history = 0;
+        header.seq = stream.next_seq[pkt.device_id]++;
+        header.flags = 0;
+        header.timestamp_ns = xbox_udp::toTimestampNs(pkt.sec, pkt.usec);
+        stream.open_frame[pkt.device_id] = index;
+    }
+
+    xbox_udp::FramePacket& frame = stream.frames[index];
+    xbox_udp::FrameEntry& entry = frame.entries[frame.header.count++];
+    entry.type = pkt.type;
+    entry.code = pkt.code;
+    entry.value = pkt.value;
+    xbox_udp::encodeNormalized(pkt.normalized, entry);
+}
+
+bool UDPPublisher::queueState(const xbox_udp::StatePacket& state) {
+    if (sock_ < 0) return false;
+
+    bool ok = true;
+    for (auto& stream : streams_) {
+        if (stream->filtered && !xbox_udp::testStateBit(stream->filter.devices, state.device_id)) continue;
+        if (stream->pending() >= MAX_BATCH) {
+            ok = flush() && ok;
+        }
+        stream->states.push_back(state);
+        xbox_udp::StatePacket& queued = stream->states.back();
+        if (stream->filtered) {
+            xbox_udp::filterState(stream->filter, queued);
+        }
+        queued.seq = stream->next_seq[state.device_id]++;
+    }
+    return ok;
+}
+
+bool UDPPublisher::flush() {
+    if (sock_ < 0) return false;
+
+    iovecs_.clear();
+    for (auto& stream : streams_) {
+        stream->first_iov = iovecs_.size();
+        for (auto& pkt : stream->queue) {
+            iovecs_.push_back({&pkt, sizeof(pkt)});
+        }
+        for (auto& frame : stream->frames) {
+            if (history_depth_ > 0) {
+                attachHistory(*stream, frame);
+            }
+            iovecs_.push_back({&frame, xbox_udp::frameSize(frame.header.count, frame.header.history)});
+        }
+        for (auto& state : stream->states) {
+            iovecs_.push_back({&state, sizeof(state)});
+        }
+        stream->iov_count = iovecs_.size() - stream->first_iov;
+    }
+
+    // Rate-limited subscribers' coalesced states ride in the same sendmmsg() batch
+    if (!subscribers_.empty()) {
+        queueSubscriberStates(Clock::now());
+        for (auto& state : sub_states_) {
+            iovecs_.push_back({&state, sizeof(state)});
+        }
+    }
+
+    bool ok = submit();
+
+    for (auto& stream : streams_) {
+        stream->queue.clear();
+        stream->frames.clear();
+        stream->states.clear();
+        stream->open_frame.fill(-1);
+    }
+    sub_states_.clear();
+    sub_targets_.clear();
+    return ok;
+}
+
+void UDPPublisher::setHistoryDepth(size_t depth) {
+    history_depth_ = std::min(depth, xbox_udp::MAX_FRAME_HISTORY);
+}
+
+void UDPPublisher::attachHistory(Stream& stream, xbox_udp::FramePacket& frame) {
+    EdgeHistory& history = stream.history[frame.header.device_id];
+    
+    // Carry the device's most recent edges from earlier frames, oldest first
+    const size_t n = std::min<size_t>(history.count, history_depth_);
+    xbox_udp::ButtonEdge* out = xbox_udp::frameHistory(frame);
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = history.edges[(history.next + xbox_udp::MAX_FRAME_HISTORY - n + i) %
+                               xbox_udp::MAX_FRAME_HISTORY];
+    }
+    frame.header.history = static_cast<uint8_t>(n);
+    
+    // Then remember this frame's own transitions for the frames that follow
+    for (uint8_t i = 0; i < frame.header.count; ++i) {
+        const xbox_udp::FrameEntry& entry = frame.entries[i];
+        if (!xbox_udp::isButtonEdge(entry.type, entry.code)) continue;
+        xbox_udp::ButtonEdge& edge = history.edges[history.next];
+        edge.seq = frame.header.seq;
+        edge.code = entry.code;
+        edge.type = static_cast<uint8_t>(entry.type);
+        edge.value = static_cast<int8_t>(std::max(-128, std::min<int32_t>(127, entry.value)));
+        history.next = static_cast<uint8_t>((history.next + 1) % xbox_udp::MAX_FRAME_HISTORY);
+        if (history.count < xbox_udp::MAX_FRAME_HISTORY) ++history.count;
+    }
+}
+
+void UDPPublisher::setSender(Sender sender) {
+    flush();
+    sender_ = std::move(sender);
+}
+
+bool UDPPublisher::setSegmentation(bool enable) {
+    if (sock_ < 0) return false;
+    if (enable && family_ != AF_INET) {
+        std::cerr << "UDP_SEGMENT: only for IPv4 destinations" << std::endl;
+        return false;
+    }
+    if (enable) {
+        // Kernels without UDP GSO don't know the option
+        int size = 0;
+        socklen_t len = sizeof(size);
+        if (getsockopt(sock_, SOL_UDP, UDP_SEGMENT, &size, &len) < 0) {
+            std::cerr << "UDP_SEGMENT: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    flush();
+    segmentation_ = enable;
+    return true;
+}
+
+bool UDPPublisher::setSocketOptions(const socket_util::SocketOptions& options) {
+    if (sock_ < 0) return false;
+    return socket_util::applySocketOptions(sock_, options, "publisher");
+}
+
+std::string UDPPublisher::describeSocketOptions() const {
+    return sock_ >= 0 ? socket_util::describeSocketOptions(sock_) : std::string();
+}
+
+void UDPPublisher::setFormat(Format format) {
+    if (format != format_) {
+        flush();
+        format_ = format;
+    }
+}
+
+void UDPPublisher::addMessage(size_t iov, struct sockaddr* addr, socklen_t addr_len) {
+    msgs_.emplace_back();
+    struct mmsghdr& msg = msgs_.back();
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_hdr.msg_iov = &iovecs_[iov];
+    msg.msg_hdr.msg_iovlen = 1;
+    if (!connected_) {
+        msg.msg_hdr.msg_name = addr;
+        msg.msg_hdr.msg_namelen = addr_len;
+    }
+}
+
+void UDPPublisher::addSegmented(size_t first, size_t count, struct sockaddr* addr, socklen_t addr_len) {
+    // Largest UDP payload over IPv4: the kernel refuses a larger segmented message
+    constexpr size_t MAX_SEGMENTED_BYTES = 65507;
+
+    const size_t end = first + count;
+    for (size_t i = first; i < end;) {
+        // A run of packets of one size, plus at most one shorter packet to end it
+        const size_t size = iovecs_[i].iov_len;
+        size_t n = 1;
+        size_t bytes = size;
+        while (i + n < end && n < MAX_SEGMENTS && iovecs_[i + n].iov_len <= size &&
+               bytes + iovecs_[i + n].iov_len <= MAX_SEGMENTED_BYTES) {
+            bytes += iovecs_[i + n].iov_len;
+            ++n;
+            if (iovecs_[i + n - 1].iov_len < size) break;
+        }
+        addMessage(i, addr, addr_len);
+        msgs_.back().msg_hdr.msg_iovlen = n;
+        i += n;
+    }
+}
+
+void UDPPublisher::addStreamMessages() {
+    // Each stream's packets go to all of its receivers, every message pointing at the
+    // same encoded buffer. With segmentation a receiver's packets are consecutive
+    // (receiver-major) so they can share messages; otherwise packet-major order.
+    // Either keeps each receiver's packets in sequence.
+    for (size_t s = 0; s < streams_.size(); ++s) {
+        Stream* stream = streams_[s].get();
+        if (segmentation_ && !sender_) {
+            if (s == 0) {
+                for (auto& dest : dests_) {
+                    addSegmented(stream->first_iov, stream->iov_count, &dest.sa, dest.len);
+                }
+            }
+            for (auto& sub : subscribers_) {
+                if (sub.stream == stream) {
+                    addSegmented(stream->first_iov, stream->iov_count,
+                                 reinterpret_cast<struct sockaddr*>(&sub.addr), sizeof(sub.addr));
+                }
+            }
+            continue;
+        }
+        for (size_t i = stream->first_iov; i < stream->first_iov + stream->iov_count; ++i) {
+            if (s == 0) {
+                for (auto& dest : dests_) {
+                    addMessage(i, &dest.sa, dest.len);
+                }
+            }
+            for (auto& sub : subscribers_) {
+                if (sub.stream == stream) {
+                    addMessage(i, reinterpret_cast<struct sockaddr*>(&sub.addr), sizeof(sub.addr));
+                }
+            }
+        }
+    }
+
+    // Attach the UDP_SEGMENT cmsgs now that msgs_ won't move
+    controls_.clear();
+    for (auto& msg : msgs_) {
+        if (msg.msg_hdr.msg_iovlen > 1) controls_.emplace_back();
+    }
+    size_t control = 0;
+    for (auto& msg : msgs_) {
+        if (msg.msg_hdr.msg_iovlen <= 1) continue;
+        SegmentControl& ctl = controls_[control++];
+        std::memset(&ctl, 0, sizeof(ctl));
+        msg.msg_hdr.msg_control = ctl.buf;
+        msg.msg_hdr.msg_controllen = sizeof(ctl.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        const uint16_t size = static_cast<uint16_t>(msg.msg_hdr.msg_iov[0].iov_len);
+        std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+    }
+}
+
+void UDPPublisher::splitSegmented(size_t from) {
+    // One message per datagram for everything not sent yet
+    std::vector<struct mmsghdr> rest(msgs_.begin() + static_cast<std::ptrdiff_t>(from), msgs_.end());
+    msgs_.resize(from);
+    for (const auto& msg : rest) {
+        for (size_t j = 0; j < msg.msg_hdr.msg_iovlen; ++j) {
+            msgs_.emplace_back();
+            struct mmsghdr& single = msgs_.back();
+            std::memset(&single, 0, sizeof(single));
+            single.msg_hdr.msg_iov = &msg.msg_hdr.msg_iov[j];
+            single.msg_hdr.msg_iovlen = 1;
+            single.msg_hdr.msg_name = msg.msg_hdr.msg_name;
+            single.msg_hdr.msg_namelen = msg.msg_hdr.msg_namelen;
+        }
+    }
+}
+
+bool UDPPublisher::submit() {
+    // iovecs_ past the streams' ranges are per-subscriber states (sub_targets_)
+    msgs_.clear();
+    size_t shared = 0;
+    for (const auto& stream : streams_) {
+        shared = std::max(shared, stream->first_iov + stream->iov_count);
+    }
+    addStreamMessages();
+    for (size_t i = 0; i < sub_targets_.size(); ++i) {
+        addMessage(shared + i, reinterpret_cast<struct sockaddr*>(&sub_targets_[i]), sizeof(sub_targets_[i]));
+    }
+    size_t count = msgs_.size();
+    if (count == 0) return true;
+
+    // sendmmsg() may accept only part of the batch (at most UIO_MAXIOV messages
+    // per call); resubmit the remainder. It fails on the first message it can't
+    // send: skip that one so one bad receiver doesn't cost the others their packets.
+    bool ok = true;
+    size_t done = 0;
+    while (done < count) {
+        int n;
+        if (sender_) {
+            n = sender_(sock_, &msgs_[done], static_cast<unsigned>(count - done), send_flags_);
+        } else {
+            n = sendmmsg(sock_, &msgs_[done], static_cast<unsigned>(count - done), send_flags_);
+            ++stats_.syscalls;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            const size_t datagrams = msgs_[done].msg_hdr.msg_iovlen;
+            if (datagrams > 1 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT)) {
+                // E.g. a route whose device can't checksum: send datagram by datagram from now on
+                std::cerr << "UDP_SEGMENT rejected: " << std::strerror(errno)
+                          << ", sending without segmentation" << std::endl;
+                segmentation_ = false;
+                splitSegmented(done);
+                count = msgs_.size();
+                continue;
+            }
+            // A Unix receiver's full queue drops the packet, as UDP would
+            if (errno != EAGAIN) {
+                std::cerr << "sendmmsg: " << std::strerror(errno) << std::endl;
+            }
+            stats_.errors += datagrams;
+            ++done;
+            ok = false;
+            continue;
+        }
+        if (n == 0) {
+            for (; done < count; ++done) stats_.errors += msgs_[done].msg_hdr.msg_iovlen;
+            ok = false;
+            break;
+        }
+        for (const size_t end = done + static_cast<size_t>(n); done < end; ++done) {
+            const size_t datagrams = msgs_[done].msg_hdr.msg_iovlen;
+            stats_.datagrams += datagrams;
+            if (datagrams > 1) ++stats_.segmented;
+        }
+    }
+    return ok;
+}
@@ -3,124 +3,550 @@
  */
 
 #include "udp_receiver.hpp"
+#include "socket_util.hpp"
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 #include <unistd.h>
 #include <poll.h>
+#include <time.h>
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
 #include <iostream>
 
-UDPReceiver::UDPReceiver(unsigned short event_port, unsigned short vibration_port)
-    : event_port_(event_port), vibration_port_(vibration_port),
-      event_sock_(-1), vib_sock_(-1) {
-}
-
-UDPReceiver::~UDPReceiver() {
-    if (event_sock_ >= 0) close(event_sock_);
-    if (vib_sock_ >= 0) close(vib_sock_);
-}
+namespace {
 
-bool UDPReceiver::bind() {
-    // Create event socket
-    event_sock_ = socket(AF_INET, SOCK_DGRAM, 0);
-    if (event_sock_ < 0) {
-        std::cerr << "socket (event): " << std::strerror(errno) << std::endl;
-        return false;
+// Create a UDP socket bound to 0.0.0.0:port, or -1 on failure
+int bind_udp_socket(unsigned short port, const char* label, bool reuse_port = false) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        std::cerr << "socket (" << label << "): " << std::strerror(errno) << std::endl;
+        return -1;
     }
     
     int opt = 1;
-    if (setsockopt(event_sock_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         std::cerr << "setsockopt SO_REUSEADDR: " << std::strerror(errno) << std::endl;
-        close(event_sock_);
-        event_sock_ = -1;
-        return false;
+        close(sock);
+        return -1;
+    }
+    
+    if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "setsockopt SO_REUSEPORT: " << std::strerror(errno) << std::endl;
+        close(sock);
+        return -1;
     }
     
     struct sockaddr_in addr;
     std::memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(event_port_);
+    addr.sin_port = htons(port);
+    
+    if (::bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "bind " << label << " socket :" << port << ": " << std::strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// True if the socket file at `addr` was left behind by a receiver that is gone:
+// connecting to it is refused. A live receiver (or any other error) keeps it.
+bool is_stale_unix_socket(const socket_util::Address& addr) {
+    int probe = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (probe < 0) return false;
+    const bool stale = connect(probe, &addr.sa, addr.len) < 0 && errno == ECONNREFUSED;
+    close(probe);
+    return stale;
+}
+
+// Create a Unix-domain datagram socket bound to `addr`, or -1 on failure. For a
+// path, `bound` receives the socket file's identity.
+int bind_unix_socket(const socket_util::Address& addr, const std::string& path, struct stat& bound) {
+    int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        std::cerr << "socket (unix): " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    
+    // Replace the socket file of an earlier receiver that is gone, but never a
+    // running receiver's or a regular file
+    struct stat st;
+    if (!path.empty() && lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) &&
+        is_stale_unix_socket(addr)) {
+        unlink(path.c_str());
+    }
     
-    if (::bind(event_sock_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        std::cerr << "bind event socket :" << event_port_ << ": " << std::strerror(errno) << std::endl;
-        close(event_sock_);
-        event_sock_ = -1;
+    if (::bind(sock, &addr.sa, addr.len) < 0) {
+        std::cerr << "bind " << addr.toString() << ": " << std::strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+    if (!path.empty() && lstat(path.c_str(), &bound) < 0) {
+        std::memset(&bound, 0, sizeof(bound));
+    }
+    return sock;
+}
+
+// Classic BPF runs on a UDP socket with the packet starting at the UDP header,
+// on a Unix socket with the payload itself
+constexpr uint32_t UDP_HDR = 8;
+
+// A protocol magic as a BPF word load sees it: loads are big-endian, the wire is little-endian
+constexpr uint32_t bpf_word(uint32_t v) {
+    return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+constexpr uint32_t BPF_ACCEPT = 0xffffffff;
+
+// Event socket: InputEventPacket, StatePacket and frames of exactly
+// frameSize(count, history) bytes. Jump offsets are relative to the next instruction.
+template <uint32_t HDR>
+const struct sock_filter EVENT_FILTER[] = {
+    /*  0 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, HDR),
+    /*  1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, bpf_word(xbox_udp::PACKET_MAGIC), 0, 2),
+    /*  2 */ BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+    /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, HDR + xbox_udp::PACKET_SIZE, 17, 18),
+    /*  4 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, bpf_word(xbox_udp::STATE_MAGIC), 0, 2),
+    /*  5 */ BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+    /*  6 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, HDR + xbox_udp::STATE_PACKET_SIZE, 14, 15),
+    /*  7 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, bpf_word(xbox_udp::FRAME_MAGIC), 0, 14),
+    // X = history * BUTTON_EDGE_SIZE
+    /*  8 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, HDR + offsetof(xbox_udp::FrameHeader, history)),
+    /*  9 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, xbox_udp::MAX_FRAME_HISTORY, 12, 0),
+    /* 10 */ BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, xbox_udp::BUTTON_EDGE_SIZE),
+    /* 11 */ BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    // X = HDR + frameSize(count, history)
+    /* 12 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, HDR + offsetof(xbox_udp::FrameHeader, count)),
+    /* 13 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 8, 0),
+    /* 14 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, xbox_udp::MAX_FRAME_ENTRIES, 7, 0),
+    /* 15 */ BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, xbox_udp::FRAME_ENTRY_SIZE),
+    /* 16 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+    /* 17 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, HDR + xbox_udp::FRAME_HEADER_SIZE),
+    /* 18 */ BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    /* 19 */ BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+    /* 20 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 0, 1),
+    /* 21 */ BPF_STMT(BPF_RET | BPF_K, BPF_ACCEPT),
+    /* 22 */ BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+// Vibration (control) socket: VibrationPacket, SubscribePacket and StateRequestPacket
+template <uint32_t HDR>
+const struct sock_filter CONTROL_FILTER[] = {
+    /*  0 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, HDR),
+    /*  1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, bpf_word(xbox_udp::VIBRATION_MAGIC), 0, 2),
+    /*  2 */ BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+    /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, HDR + xbox_udp::VIBRATION_PACKET_SIZE, 6, 7),
+    /*  4 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, bpf_word(xbox_udp::SUBSCRIBE_MAGIC), 0, 2),
+    /*  5 */ BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+    /*  6 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, HDR + xbox_udp::SUBSCRIBE_PACKET_SIZE, 3, 4),
+    /*  7 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, bpf_word(xbox_udp::STATE_REQUEST_MAGIC), 0, 3),
+    /*  8 */ BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+    /*  9 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, HDR + xbox_udp::STATE_REQUEST_PACKET_SIZE, 0, 1),
+    /* 10 */ BPF_STMT(BPF_RET | BPF_K, BPF_ACCEPT),
+    /* 11 */ BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+// Attach a classic BPF program; on failure the receiver still validates in userspace
+template <size_t N>
+void attach_filter(int sock, const struct sock_filter (&program)[N], const char* label) {
+    struct sock_fprog fprog;
+    fprog.len = static_cast<unsigned short>(N);
+    fprog.filter = const_cast<struct sock_filter*>(program);
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+        std::cerr << "setsockopt SO_ATTACH_FILTER (" << label << "): " << std::strerror(errno) << std::endl;
+    }
+}
+
+}  // namespace
+
+UDPReceiverBase::UDPReceiverBase(unsigned short event_port, unsigned short vibration_port)
+    : event_sock_(-1), vib_sock_(-1),
+      event_port_(event_port), vibration_port_(vibration_port),
+      recv_bufs_(RECV_BATCH), recv_addrs_(RECV_BATCH),
+      recv_iovecs_(RECV_BATCH), recv_msgs_(RECV_BATCH), recv_control_(RECV_BATCH) {
+    for (size_t i = 0; i < RECV_BATCH; ++i) {
+        recv_iovecs_[i].iov_base = recv_bufs_[i].data;
+        recv_iovecs_[i].iov_len = sizeof(recv_bufs_[i].data);
+        std::memset(&recv_msgs_[i], 0, sizeof(recv_msgs_[i]));
+        recv_msgs_[i].msg_hdr.msg_iov = &recv_iovecs_[i];
+        recv_msgs_[i].msg_hdr.msg_iovlen = 1;
+        recv_msgs_[i].msg_hdr.msg_name = &recv_addrs_[i];
+        recv_msgs_[i].msg_hdr.msg_namelen = sizeof(recv_addrs_[i]);
+    }
+}
+
+UDPReceiverBase::~UDPReceiverBase() {
+    unsubscribe();
+    if (event_sock_ >= 0) close(event_sock_);
+    if (vib_sock_ >= 0) close(vib_sock_);
+    // Only our own socket file: another receiver may have replaced it since
+    struct stat st;
+    if (!unix_path_.empty() && lstat(unix_path_.c_str(), &st) == 0 &&
+        st.st_dev == unix_dev_ && st.st_ino == unix_ino_) {
+        unlink(unix_path_.c_str());
+    }
+}
+
+bool UDPReceiverBase::bindEventSocket() {
+    if (unix_endpoint_.empty()) {
+        event_sock_ = bind_udp_socket(event_port_, "event", reuse_port_);
+        if (event_sock_ < 0) {
+            return false;
+        }
+        if (!multicast_group_.empty() && !joinMulticastGroup()) {
+            close(event_sock_);
+            event_sock_ = -1;
+            return false;
+        }
+        if (kernel_filter_) {
+            attach_filter(event_sock_, EVENT_FILTER<UDP_HDR>, "event");
+        }
+        return true;
+    }
+
+    socket_util::Address addr;
+    if (!socket_util::isUnixEndpoint(unix_endpoint_) || !socket_util::parseEndpoint(unix_endpoint_, 0, addr)) {
+        std::cerr << "event socket " << unix_endpoint_ << ": expected unix:/path or unix:@name" << std::endl;
         return false;
     }
+    if (!multicast_group_.empty()) {
+        std::cerr << "event socket " << unix_endpoint_ << ": multicast needs a UDP socket" << std::endl;
+        return false;
+    }
+    const std::string path = addr.un.sun_path[0] != '\0' ? addr.un.sun_path : "";
+    struct stat bound;
+    event_sock_ = bind_unix_socket(addr, path, bound);
+    if (event_sock_ < 0) {
+        return false;
+    }
+    unix_path_ = path;
+    unix_dev_ = bound.st_dev;
+    unix_ino_ = bound.st_ino;
+    if (kernel_filter_) {
+        attach_filter(event_sock_, EVENT_FILTER<0>, "event");
+    }
+    return true;
+}
+
+bool UDPReceiverBase::bind() {
+    // Create event socket
+    if (hasEventSocket()) {
+        if (!bindEventSocket()) {
+            return false;
+        }
+        if (latency_stats_) {
+            int on = 1;
+            if (setsockopt(event_sock_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+                std::cerr << "setsockopt SO_TIMESTAMPNS: " << std::strerror(errno) << std::endl;
+            }
+            for (size_t i = 0; i < RECV_BATCH; ++i) {
+                recv_msgs_[i].msg_hdr.msg_control = recv_control_[i].data;
+                recv_msgs_[i].msg_hdr.msg_controllen = sizeof(recv_control_[i].data);
+            }
+        }
+        if (!socket_options_.empty()) {
+            socket_util::applySocketOptions(event_sock_, socket_options_, "event");
+        }
+    }
     
     // Create vibration socket
-    vib_sock_ = socket(AF_INET, SOCK_DGRAM, 0);
-    if (vib_sock_ < 0) {
-        std::cerr << "socket (vibration): " << std::strerror(errno) << std::endl;
-        close(event_sock_);
-        event_sock_ = -1;
+    if (vibration_port_ != 0) {
+        vib_sock_ = bind_udp_socket(vibration_port_, "vibration");
+        if (vib_sock_ < 0) {
+            if (event_sock_ >= 0) close(event_sock_);
+            event_sock_ = -1;
+            return false;
+        }
+        if (kernel_filter_) {
+            attach_filter(vib_sock_, CONTROL_FILTER<UDP_HDR>, "vibration");
+        }
+        if (!socket_options_.empty()) {
+            socket_util::applySocketOptions(vib_sock_, socket_options_, "vibration");
+        }
+    }
+    
+    return true;
+}
+
+std::string UDPReceiverBase::describeSocketOptions() const {
+    const int sock = event_sock_ >= 0 ? event_sock_ : vib_sock_;
+    return sock >= 0 ? socket_util::describeSocketOptions(sock) : std::string();
+}
+
+bool UDPReceiverBase::joinMulticastGroup() {
+    struct ip_mreqn mreq;
+    if (!socket_util::resolveInterface(multicast_iface_, mreq)) {
+        return false;
+    }
+    if (inet_pton(AF_INET, multicast_group_.c_str(), &mreq.imr_multiaddr) != 1 ||
+        !socket_util::isMulticast(mreq.imr_multiaddr)) {
+        std::cerr << "multicast group " << multicast_group_ << ": invalid address" << std::endl;
         return false;
     }
     
-    if (setsockopt(vib_sock_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "setsockopt SO_REUSEADDR: " << std::strerror(errno) << std::endl;
-        close(vib_sock_);
-        close(event_sock_);
-        vib_sock_ = -1;
-        event_sock_ = -1;
+    if (setsockopt(event_sock_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        std::cerr << "setsockopt IP_ADD_MEMBERSHIP " << multicast_group_ << ": "
+                  << std::strerror(errno) << std::endl;
         return false;
     }
     
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(vibration_port_);
-    
-    if (::bind(vib_sock_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        std::cerr << "bind vibration socket :" << vibration_port_ << ": " << std::strerror(errno) << std::endl;
-        close(vib_sock_);
-        close(event_sock_);
-        vib_sock_ = -1;
-        event_sock_ = -1;
+    // Only deliver the group we joined, not every group another socket on this host joined
+    int all = 0;
+    if (setsockopt(event_sock_, IPPROTO_IP, IP_MULTICAST_ALL, &all, sizeof(all)) < 0) {
+        std::cerr << "setsockopt IP_MULTICAST_ALL: " << std::strerror(errno) << std::endl;
+    }
+    return true;
+}
+
+bool UDPReceiverBase::subscribe(const std::string& publisher, unsigned short control_port,
+                                uint16_t max_rate_hz, const xbox_udp::SubscribeFilter* filter,
+                                uint32_t lease_ms) {
+    if (event_sock_ < 0 || !unix_endpoint_.empty()) {
+        std::cerr << "subscribe: no UDP event socket bound" << std::endl;
+        return false;
+    }
+    if (!socket_util::parseAddress(publisher, control_port, control_addr_)) {
         return false;
     }
     
+    std::memset(&subscription_, 0, sizeof(subscription_));
+    subscription_.magic = xbox_udp::SUBSCRIBE_MAGIC;
+    subscription_.version = xbox_udp::SUBSCRIBE_VERSION;
+    subscription_.event_port = 0;  // Reply to the event socket we send from
+    subscription_.max_rate_hz = max_rate_hz;
+    subscription_.lease_ms = std::max(xbox_udp::MIN_LEASE_MS, std::min(xbox_udp::MAX_LEASE_MS, lease_ms));
+    if (filter) {
+        subscription_.flags = xbox_udp::SUBSCRIBE_FILTER;
+        subscription_.filter = *filter;
+    }
+    subscribed_ = true;
+    return sendSubscription();
+}
+
+void UDPReceiverBase::unsubscribe() {
+    if (!subscribed_) return;
+    subscription_.flags = xbox_udp::SUBSCRIBE_CANCEL;
+    sendSubscription();
+    subscribed_ = false;
+}
+
+bool UDPReceiverBase::requestState(const std::string& publisher, unsigned short control_port,
+                                   uint8_t device_id) {
+    if (event_sock_ < 0 || !unix_endpoint_.empty()) {
+        std::cerr << "requestState: no UDP event socket bound" << std::endl;
+        return false;
+    }
+    struct sockaddr_in addr;
+    if (!socket_util::parseAddress(publisher, control_port, addr)) {
+        return false;
+    }
+
+    xbox_udp::StateRequestPacket request;
+    std::memset(&request, 0, sizeof(request));
+    request.magic = xbox_udp::STATE_REQUEST_MAGIC;
+    request.version = xbox_udp::STATE_REQUEST_VERSION;
+    request.device_id = device_id;
+    request.reply_port = 0;  // Reply to the event socket we send from
+    ssize_t sent = sendto(event_sock_, &request, sizeof(request), 0,
+                          reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr));
+    if (sent != static_cast<ssize_t>(sizeof(request))) {
+        std::cerr << "sendto state request: " << std::strerror(errno) << std::endl;
+        return false;
+    }
     return true;
 }
 
-void UDPReceiver::poll(int timeout_ms) {
+bool UDPReceiverBase::sendSubscription() {
+    // Refresh at a third of the lease so one lost registration doesn't expire it
+    next_refresh_ = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(subscription_.lease_ms / 3);
+    ssize_t sent = sendto(event_sock_, &subscription_, sizeof(subscription_), 0,
+                          reinterpret_cast<const struct sockaddr*>(&control_addr_), sizeof(control_addr_));
+    if (sent != static_cast<ssize_t>(sizeof(subscription_))) {
+        std::cerr << "sendto subscribe: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+unsigned UDPReceiverBase::waitReady(int timeout_ms) {
+    if (subscribed_) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= next_refresh_) {
+            sendSubscription();
+        }
+        const auto until_refresh = std::chrono::duration_cast<std::chrono::milliseconds>(
+            next_refresh_ - now).count();
+        if (timeout_ms < 0 || until_refresh < timeout_ms) {
+            timeout_ms = static_cast<int>(std::max<int64_t>(until_refresh, 0));
+        }
+    }
+    
     struct pollfd pfds[2];
-    pfds[0].fd = event_sock_;
+    pfds[0].fd = event_sock_;  // Negative fds (disabled sockets) are ignored by poll()
     pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
     pfds[1].fd = vib_sock_;
     pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
     
     int r = ::poll(pfds, 2, timeout_ms);
     if (r < 0) {
         if (errno != EINTR) {
             std::cerr << "poll: " << std::strerror(errno) << std::endl;
         }
-        return;
+        return 0;
     }
-    if (r == 0) return;
     
-    // Check event socket
-    if (pfds[0].revents & POLLIN) {
-        xbox_udp::InputEventPacket pkt;
-        ssize_t n = recv(event_sock_, &pkt, sizeof(pkt), MSG_DONTWAIT);
-        if (n == static_cast<ssize_t>(sizeof(pkt)) && pkt.magic == xbox_udp::PACKET_MAGIC) {
-            if (event_callback_) {
-                event_callback_(pkt);
-            }
+    unsigned ready = 0;
+    if (pfds[0].revents & POLLIN) ready |= EVENT_READY;
+    if (pfds[1].revents & POLLIN) ready |= CONTROL_READY;
+    return ready;
+}
+
+size_t UDPReceiverBase::receiveBatch(int sock) {
+    // The headers are set up once; recvmmsg() only updates msg_len, msg_flags and
+    // msg_namelen of the messages it fills
+    int n;
+    do {
+        n = recvmmsg(sock, recv_msgs_.data(), static_cast<unsigned>(RECV_BATCH), MSG_DONTWAIT, nullptr);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cerr << "recvmmsg: " << std::strerror(errno) << std::endl;
         }
+        return 0;
     }
+    if (n == 0) return 0;
     
-    // Check vibration socket
-    if (pfds[1].revents & POLLIN) {
-        xbox_udp::VibrationPacket pkt;
-        ssize_t n = recv(vib_sock_, &pkt, sizeof(pkt), MSG_DONTWAIT);
-        if (n == static_cast<ssize_t>(sizeof(pkt)) && pkt.magic == xbox_udp::VIBRATION_MAGIC) {
-            if (vibration_callback_) {
-                vibration_callback_(pkt);
+    ++recv_stats_.syscalls;
+    ++recv_stats_.batch_sizes[n];
+    recv_stats_.datagrams += static_cast<uint64_t>(n);
+    return static_cast<size_t>(n);
+}
+
+const void* UDPReceiverBase::batchPacket(size_t i, size_t& len) {
+    struct msghdr& hdr = recv_msgs_[i].msg_hdr;
+    const struct sockaddr_in& from = recv_addrs_[i];
+    if (hdr.msg_namelen >= sizeof(from) && from.sin_family == AF_INET) {
+        packet_source_ = (static_cast<uint64_t>(from.sin_addr.s_addr) << 16) | from.sin_port;
+    } else {
+        packet_source_ = 0;  // Unbound Unix socket sender
+    }
+    hdr.msg_namelen = sizeof(recv_addrs_[i]);
+    if (hdr.msg_control) {
+        packet_rx_ns_ = 0;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec ts;
+                std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                packet_rx_ns_ = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
             }
         }
+        hdr.msg_controllen = sizeof(recv_control_[i].data);
+    }
+    if (hdr.msg_flags & MSG_TRUNC) {
+        // Larger than any valid packet
+        ++recv_stats_.invalid;
+        return nullptr;
     }
+    len = recv_msgs_[i].msg_len;
+    return recv_bufs_[i].data;
+}
+
+void UDPReceiverBase::recordLatency(uint8_t device_id, uint64_t timestamp_ns) {
+    if (packet_rx_ns_ == 0) return;  // Control socket, or no timestamp
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const uint64_t now_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+
+    std::unique_ptr<LatencyStats>& stats = latency_[device_id];
+    if (!stats) stats.reset(new LatencyStats());
+    stats->network.record(static_cast<int64_t>(packet_rx_ns_ - timestamp_ns));
+    stats->receive.record(static_cast<int64_t>(now_ns - packet_rx_ns_));
+}
+
+void UDPReceiverBase::resetLatencyStats() {
+    for (auto& stats : latency_) stats.reset();
+}
+
+SequenceTracker& UDPReceiverBase::sequenceTracker(uint8_t device_id) {
+    std::vector<SourceTracker>& sources = trackers_[device_id];
+    ++tracker_clock_;
+    SourceTracker* oldest = nullptr;
+    for (SourceTracker& entry : sources) {
+        if (entry.source == packet_source_) {
+            entry.last_used = tracker_clock_;
+            return entry.tracker;
+        }
+        if (!oldest || entry.last_used < oldest->last_used) oldest = &entry;
+    }
+    if (sources.size() < MAX_SEQUENCE_SOURCES) {
+        sources.push_back(SourceTracker{packet_source_, tracker_clock_, SequenceTracker()});
+        return sources.back().tracker;
+    }
+    // Start over for the new source; its stats replace the evicted one's
+    *oldest = SourceTracker{packet_source_, tracker_clock_, SequenceTracker()};
+    return oldest->tracker;
+}
+
+bool UDPReceiverBase::acceptSequence(SequenceTracker& tracker, uint32_t seq) {
+    SequenceTracker::Result result = tracker.update(seq);
+    if (drop_out_of_order_ && !SequenceTracker::isInOrder(result)) {
+        ++dropped_out_of_order_;
+        return false;
+    }
+    return true;
+}
+
+SequenceStats UDPReceiverBase::getSequenceStats(uint8_t device_id) const {
+    SequenceStats total;
+    for (const SourceTracker& entry : trackers_[device_id]) {
+        total += entry.tracker.getStats();
+    }
+    return total;
+}
+
+SequenceStats UDPReceiverBase::getTotalSequenceStats() const {
+    SequenceStats total;
+    for (const auto& sources : trackers_) {
+        for (const SourceTracker& entry : sources) {
+            total += entry.tracker.getStats();
+        }
+    }
+    return total;
+}
+
+// The callback receiver is compiled once here instead of in every user
+template class UDPReceiverT<ReceiverCallbacks>;
+
+void UDPReceiver::setJitterBuffer(const JitterBuffer::Config& config) {
+    jitter_.reset(new JitterBuffer(config));
+    handler_.jitter = jitter_.get();
+}
+
+void UDPReceiver::poll(int timeout_ms) {
+    if (!jitter_) {
+        UDPReceiverT<ReceiverCallbacks>::poll(timeout_ms);
+        return;
+    }
+    
+    // Wake up in time for the next playout (rounded up to whole milliseconds)
+    const uint64_t next = jitter_->nextPlayoutNs();
+    if (next != 0) {
+        const uint64_t now = JitterBuffer::nowNs();
+        const int until_next = next > now ? static_cast<int>((next - now + 999999) / 1000000) : 0;
+        if (timeout_ms < 0 || until_next < timeout_ms) {
+            timeout_ms = until_next;
+        }
+    }
+    UDPReceiverT<ReceiverCallbacks>::poll(timeout_ms);
+    
+    ReceiverCallbacks::Playout playout{handler_};
+    jitter_->release(JitterBuffer::nowNs(), playout);
 }
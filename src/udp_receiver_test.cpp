@@ -8,118 +8,92 @@
 
 #include "xbox_udp_protocol.hpp"
 #include "controller_config.hpp"
+#include "controller_state_table.hpp"
+#include "shm_transport.hpp"
+#include "socket_util.hpp"
+#include "udp_receiver.hpp"
 
 #include <linux/input-event-codes.h>
 #include <linux/input.h>
 
-#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <iomanip>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
-#include <poll.h>
-#include <map>
-#include <unordered_map>
 #include <set>
 #include <cstdlib>
 #include <filesystem>
 #include <iomanip>
 #include <cmath>
+#include <getopt.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace {
 
-struct ControllerState {
-    std::map<unsigned, bool> buttons;  // button code -> pressed state
-    std::map<std::string, bool> dpad_buttons;  // dpad button name -> pressed state (e.g., "Dpad-Left")
-    std::map<unsigned, int32_t> axes;   // axis code -> raw value
-    std::map<unsigned, double> normalized_axes;  // axis code -> normalized value
-    std::shared_ptr<ControllerConfig> config;
-};
-
-std::unordered_map<uint8_t, ControllerState> controller_states;
-
-void update_state(const xbox_udp::InputEventPacket& pkt) {
-    if (pkt.magic != xbox_udp::PACKET_MAGIC) return;
-    if (pkt.type == EV_SYN) return;
+ControllerStateTable controller_states;
+// Set when reading from a shared-memory segment instead of UDP
+const ShmReader* shm_reader = nullptr;
 
-    ControllerState& state = controller_states[pkt.device_id];
-    
-    // Auto-detect config on first event if not set
-    if (!state.config) {
-        std::string config_dir = "config";
-        if (!std::filesystem::exists(config_dir)) {
-            config_dir = "/usr/share/xbox_control/config";
-        }
-        // Try to load a default config (xbox_controller.yaml)
-        std::string default_config = config_dir + "/xbox_controller.yaml";
-        if (std::filesystem::exists(default_config)) {
-            state.config = ConfigManager::getInstance().loadConfig(default_config);
-        }
+// Default controller config (xbox_controller.yaml) for button/axis names and dpad buttons
+std::shared_ptr<ControllerConfig> load_default_config() {
+    std::string config_dir = "config";
+    if (!std::filesystem::exists(config_dir)) {
+        config_dir = "/usr/share/xbox_control/config";
     }
-
-    if (pkt.type == EV_KEY) {
-        state.buttons[pkt.code] = (pkt.value != 0);
-    } else if (pkt.type == EV_ABS) {
-        // Check if this is a dpad axis that should be converted to buttons
-        if (state.config && state.config->isDpadAxis(pkt.code)) {
-            // Convert dpad axis to button states
-            const std::string* button_name = state.config->getDpadButtonName(pkt.code, pkt.value);
-            if (button_name) {
-                // Set this dpad button to pressed
-                state.dpad_buttons[*button_name] = true;
-                // Set other dpad buttons on the same axis to released
-                for (const auto& dpad : state.config->getDpadButtonMappings()) {
-                    if (dpad.axis_code == pkt.code && dpad.value != pkt.value) {
-                        state.dpad_buttons[dpad.name] = false;
-                    }
-                }
-            } else if (pkt.value == 0) {
-                // Center position - release all dpad buttons on this axis
-                for (const auto& dpad : state.config->getDpadButtonMappings()) {
-                    if (dpad.axis_code == pkt.code) {
-                        state.dpad_buttons[dpad.name] = false;
-                    }
-                }
-            }
-        }
-        state.axes[pkt.code] = pkt.value;
-        state.normalized_axes[pkt.code] = pkt.normalized;
+    std::string default_config = config_dir + "/xbox_controller.yaml";
+    if (!std::filesystem::exists(default_config)) {
+        return nullptr;
     }
+    return ConfigManager::getInstance().loadConfig(default_config);
+}
+
+void print_latency(const char* label, const LatencyHistogram& histogram) {
+    std::cout << label << " latency (us): p50 " << std::fixed << std::setprecision(1)
+              << histogram.percentile(50) / 1000.0 << ", p99 " << histogram.percentile(99) / 1000.0
+              << ", p99.9 " << histogram.percentile(99.9) / 1000.0 << ", max " << histogram.max() / 1000.0
+              << " (" << histogram.count() << " packets";
+    if (histogram.negative()) std::cout << ", " << histogram.negative() << " negative: clocks out of sync";
+    std::cout << ")" << std::endl;
 }
 
-void print_status() {
+void print_status(const UDPReceiver& receiver) {
     // Clear screen and move cursor to top
     std::cout << "\033[2J\033[H";
     
     std::cout << "=== Xbox Controller Status ===" << std::endl << std::endl;
 
-    for (const auto& [device_id, state] : controller_states) {
+    const std::shared_ptr<const ControllerConfig>& config = controller_states.getConfig();
+    for (uint8_t device_id : controller_states.devices()) {
+        const ControllerStateTable::DeviceState& state = *controller_states.device(device_id);
         std::cout << "Controller [" << (int)device_id << "]" << std::endl;
         std::cout << "----------------------------" << std::endl;
         
         // Print buttons using config
         std::cout << "Buttons:" << std::endl;
-        if (state.config) {
+        if (config) {
             // Use config-defined button order
-            for (const auto& btn : state.config->getButtonMappings()) {
-                bool pressed = state.buttons.count(btn.code) ? state.buttons.at(btn.code) : false;
+            for (const auto& btn : config->getButtonMappings()) {
+                bool pressed = controller_states.button(device_id, btn.code);
                 std::cout << "  " << std::setw(10) << std::left << btn.name 
                           << ": " << (pressed ? "[PRESSED ]" : "[        ]") << std::endl;
             }
             
             // Print dpad buttons
-            for (const auto& dpad : state.config->getDpadButtonMappings()) {
-                bool pressed = state.dpad_buttons.count(dpad.name) ? state.dpad_buttons.at(dpad.name) : false;
+            const auto& dpad_buttons = config->getDpadButtonMappings();
+            for (size_t i = 0; i < dpad_buttons.size(); ++i) {
+                const DpadButtonMapping& dpad = dpad_buttons[i];
+                bool pressed = controller_states.dpadButton(device_id, i);
                 std::cout << "  " << std::setw(10) << std::left << dpad.name 
                           << ": " << (pressed ? "[PRESSED ]" : "[        ]") << std::endl;
             }
         }
         
         // Print any other buttons not in config
-        for (const auto& [code, pressed] : state.buttons) {
-            if (!state.config || !state.config->getButtonName(code)) {
+        for (unsigned code = 0; code < ControllerStateTable::KEY_COUNT; ++code) {
+            if (!state.reported_keys[code]) continue;
+            const bool pressed = state.buttons[code];
+            if (!config || !config->getButtonName(code)) {
                 std::cout << "  " << std::setw(10) << std::left << ("Btn-" + std::to_string(code))
                           << ": " << (pressed ? "[PRESSED ]" : "[        ]") << std::endl;
             }
@@ -129,15 +103,14 @@ void print_status() {
         std::cout << "Axes:" << std::endl;
         
         // Print axes using config (including dpad axes for redundancy)
-        if (state.config) {
+        if (config) {
             std::set<unsigned> processed_axes;  // Track which axes we've already displayed
             
-            for (const auto& axis : state.config->getAxisMappings()) {
+            for (const auto& axis : config->getAxisMappings()) {
                 if (processed_axes.count(axis.code)) continue;
                 
-                int32_t raw_value = state.axes.count(axis.code) ? state.axes.at(axis.code) : 0;
-                double normalized_value = state.normalized_axes.count(axis.code) ? 
-                                         state.normalized_axes.at(axis.code) : 0.0;
+                int32_t raw_value = controller_states.axis(device_id, axis.code);
+                double normalized_value = controller_states.normalized(device_id, axis.code);
                 
                 // Check if this is part of a stick pair (Left-X/Y or Right-X/Y)
                 bool is_paired = false;
@@ -145,7 +118,7 @@ void print_status() {
                 if (axis.name.find("Left-X") != std::string::npos || 
                     axis.name.find("Right-X") != std::string::npos) {
                     // Find the corresponding Y axis
-                    for (const auto& other : state.config->getAxisMappings()) {
+                    for (const auto& other : config->getAxisMappings()) {
                         if (other.code != axis.code && 
                             ((axis.name.find("Left") != std::string::npos && other.name.find("Left-Y") != std::string::npos) ||
                              (axis.name.find("Right") != std::string::npos && other.name.find("Right-Y") != std::string::npos))) {
@@ -158,9 +131,8 @@ void print_status() {
                 
                 if (is_paired && paired_axis) {
                     // Display as combined stick (X,Y)
-                    int32_t raw_y = state.axes.count(paired_axis->code) ? state.axes.at(paired_axis->code) : 0;
-                    double norm_y = state.normalized_axes.count(paired_axis->code) ? 
-                                   state.normalized_axes.at(paired_axis->code) : 0.0;
+                    int32_t raw_y = controller_states.axis(device_id, paired_axis->code);
+                    double norm_y = controller_states.normalized(device_id, paired_axis->code);
                     
                     // Extract stick name (Left or Right)
                     std::string stick_name = axis.name.substr(0, axis.name.find("-X"));
@@ -177,6 +149,9 @@ void print_status() {
                                   << std::abs(normalized_value) << ", " << y_dir << " " 
                                   << std::abs(norm_y) << ")";
                     }
+                    if (state.predicted[axis.code] || state.predicted[paired_axis->code]) {
+                        std::cout << " (predicted)";
+                    }
                     std::cout << std::endl;
                     
                     processed_axes.insert(axis.code);
@@ -186,7 +161,7 @@ void print_status() {
                     std::cout << "  " << std::setw(10) << std::left << axis.name;
                     
                     // Special handling for dpad axes to show directional text
-                    if (state.config->isDpadAxis(axis.code)) {
+                    if (config->isDpadAxis(axis.code)) {
                         std::string direction;
                         if (axis.name.find("Dpad-X") != std::string::npos) {
                             if (raw_value == -1) direction = "Left";
@@ -205,6 +180,7 @@ void print_status() {
                     } else {
                         std::cout << ": " << std::setw(8) << std::right << raw_value;
                     }
+                    if (state.predicted[axis.code]) std::cout << " (predicted)";
                     std::cout << std::endl;
                     
                     processed_axes.insert(axis.code);
@@ -213,89 +189,369 @@ void print_status() {
         }
         
         // Print any other axes not in config
-        for (const auto& [code, value] : state.axes) {
-            if (!state.config || !state.config->getAxisMapping(code)) {
+        for (unsigned code = 0; code < ControllerStateTable::AXIS_COUNT; ++code) {
+            if (!state.reported_axes[code]) continue;
+            if (!config || !config->getAxisMapping(code)) {
                 std::cout << "  " << std::setw(10) << std::left << ("Axis-" + std::to_string(code))
-                          << ": " << std::setw(8) << std::right << value << std::endl;
+                          << ": " << std::setw(8) << std::right << state.axes[code] << std::endl;
             }
         }
         
+        // Sequence accounting (frame/state packets only; legacy events carry no sequence)
+        const SequenceStats seq = receiver.getSequenceStats(device_id);
+        if (seq.received > 0) {
+            std::cout << std::endl;
+            std::cout << "Packets: " << seq.received << " received, " << seq.lost << " lost, "
+                      << seq.duplicates << " duplicate, " << seq.reordered << " reordered, "
+                      << seq.recovered << " edges recovered" << std::endl;
+        }
+
+        // Where the time goes: publisher + network vs. our socket queue and dispatch
+        if (const UDPReceiver::LatencyStats* latency = receiver.getLatencyStats(device_id)) {
+            print_latency("Network", latency->network);
+            print_latency("Receive", latency->receive);
+        }
+        
         std::cout << std::endl;
     }
     
+    // Datagrams per recvmmsg() call: how bursty the arrivals are
+    const UDPReceiver::ReceiveStats& recv_stats = receiver.getReceiveStats();
+    if (recv_stats.syscalls > 0) {
+        std::cout << "Received " << recv_stats.datagrams << " datagrams in " << recv_stats.syscalls
+                  << " recvmmsg() calls (" << recv_stats.invalid << " invalid); batch sizes:";
+        for (size_t n = 1; n < recv_stats.batch_sizes.size(); ++n) {
+            if (recv_stats.batch_sizes[n]) std::cout << " " << n << ":" << recv_stats.batch_sizes[n];
+        }
+        std::cout << std::endl;
+    }
+    
+    if (shm_reader) {
+        const ShmReader::Stats& shm_stats = shm_reader->getStats();
+        std::cout << "Shared memory: " << shm_stats.frames << " frames, " << shm_stats.lost << " lost, "
+                  << shm_stats.waits << " waits" << (shm_reader->isClosed() ? " (publisher closed)" : "")
+                  << std::endl;
+    }
+    
+    // Smoothing cost: delay added by the jitter buffer and packets that came too late
+    if (const JitterBuffer* jitter = receiver.getJitterBuffer()) {
+        const JitterBuffer::Stats stats = jitter->getStats();
+        std::cout << "Jitter buffer: delay " << stats.delay_us / 1000.0 << " ms (jitter "
+                  << stats.jitter_us / 1000.0 << " ms), added " << std::fixed << std::setprecision(1)
+                  << stats.meanAddedLatencyUs() / 1000.0 << " ms avg / "
+                  << stats.max_added_latency_ns / 1e6 << " ms max, " << stats.late << " late, "
+                  << stats.late_dropped << " late drops" << std::endl;
+    }
+    
     std::cout.flush();
 }
 
+// Frames from the shared-memory ring go straight into the state table
+struct ShmApply : PacketHandler {
+    void onFrame(const xbox_udp::FramePacket& frame) { controller_states.apply(frame); }
+};
+
+// Start from the state block: controllers show their current state right away
+void load_shm_states(const ShmReader& reader) {
+    for (unsigned device_id = 0; device_id < ControllerStateTable::MAX_DEVICES; ++device_id) {
+        xbox_udp::StatePacket state;
+        if (reader.readState(static_cast<uint8_t>(device_id), state)) controller_states.apply(state);
+    }
+}
+
+int run_shm(const std::string& name, bool predict) {
+    ShmReader reader(name);
+    if (!reader.open()) return 1;
+    shm_reader = &reader;
+    UDPReceiver receiver(0, 0);  // Never bound; print_status() shows no UDP statistics
+
+    controller_states.setConfig(load_default_config());
+    if (predict) {
+        controller_states.setPrediction(AxisPredictor::Config());
+    }
+    load_shm_states(reader);
+    std::cout << "UDP Receiver Test: reading shared memory " << name << std::endl;
+    print_status(receiver);
+
+    ShmApply apply;
+    for (;;) {
+        bool changed = reader.poll(apply, predict ? 1 : 100) > 0;
+        if (predict && controller_states.predict() > 0) changed = true;
+        if (reader.isClosed()) {
+            // Follow a restarted publisher
+            print_status(receiver);
+            sleep(1);
+            if (!reader.open()) continue;
+            load_shm_states(reader);
+            changed = true;
+        }
+        if (changed) print_status(receiver);
+    }
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {
     unsigned short port = xbox_udp::DEFAULT_PORT;
-    if (argc >= 2) port = static_cast<unsigned short>(std::stoul(argv[1]));
+    std::string group;
+    std::string iface;
+    std::string publisher;
+    unsigned short publisher_port = xbox_udp::DEFAULT_PORT;
+    unsigned long rate_hz = 0;
+    // Filter: all devices/keys/axes unless restricted. Naming any key or axis
+    // selects exactly the named codes.
+    xbox_udp::SubscribeFilter filter;
+    xbox_udp::setFilterAll(filter);
+    bool filtered = false;
+    bool devices_named = false;
+    bool codes_named = false;
+    bool kernel_filter = true;
+    unsigned long jitter_ms = 0;
+    unsigned long jitter_max_ms = 0;
+    // Publisher asked for the current state at startup (defaults to the --subscribe one)
+    std::string state_host;
+    unsigned short state_port = xbox_udp::DEFAULT_PORT;
+    bool predict = false;
+    std::string shm_name;
+    std::string socket_profile;
+    std::vector<std::pair<std::string, std::string>> socket_flags;
 
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        std::cerr << "socket: " << std::strerror(errno) << std::endl;
+    static const struct option long_options[] = {
+        {"group", required_argument, nullptr, 'g'},
+        {"interface", required_argument, nullptr, 'i'},
+        {"subscribe", required_argument, nullptr, 's'},
+        {"rate", required_argument, nullptr, 'r'},
+        {"device", required_argument, nullptr, 'd'},
+        {"key", required_argument, nullptr, 'k'},
+        {"axis", required_argument, nullptr, 'a'},
+        {"no-kernel-filter", no_argument, nullptr, 'n'},
+        {"jitter-ms", required_argument, nullptr, 'j'},
+        {"jitter-max-ms", required_argument, nullptr, 'J'},
+        {"state-from", required_argument, nullptr, 'q'},
+        {"predict", no_argument, nullptr, 'p'},
+        {"shm", required_argument, nullptr, 'm'},
+        {"socket-profile", required_argument, nullptr, 'P'},
+        {"busy-poll", required_argument, nullptr, 'O'},
+        {"priority", required_argument, nullptr, 'O'},
+        {"dscp", required_argument, nullptr, 'O'},
+        {"sndbuf", required_argument, nullptr, 'O'},
+        {"rcvbuf", required_argument, nullptr, 'O'},
+        {"rcvlowat", required_argument, nullptr, 'O'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "h", long_options, &option_index)) != -1) {
+        switch (opt) {
+        case 'g':
+            group = optarg;
+            break;
+        case 'i':
+            iface = optarg;
+            break;
+        case 's':
+        case 'q': {
+            std::string& host = opt == 's' ? publisher : state_host;
+            unsigned short& host_port = opt == 's' ? publisher_port : state_port;
+            host = optarg;
+            const size_t colon = host.find(':');
+            if (colon != std::string::npos) {
+                host_port = static_cast<unsigned short>(std::stoul(host.substr(colon + 1)));
+                host.resize(colon);
+            }
+            break;
+        }
+        case 'r':
+            rate_hz = std::stoul(optarg);
+            if (rate_hz > 65535) rate_hz = 65535;
+            break;
+        case 'd': {
+            if (!devices_named) {
+                std::memset(filter.devices, 0, sizeof(filter.devices));
+                devices_named = true;
+            }
+            const unsigned long device = std::stoul(optarg);
+            if (device > 255) return 1;
+            xbox_udp::setStateBit(filter.devices, static_cast<unsigned>(device), true);
+            filtered = true;
+            break;
+        }
+        case 'k':
+        case 'a': {
+            if (!codes_named) {
+                std::memset(filter.keys, 0, sizeof(filter.keys));
+                std::memset(filter.axes, 0, sizeof(filter.axes));
+                codes_named = true;
+            }
+            const unsigned long code = std::stoul(optarg, nullptr, 0);
+            if (code >= (opt == 'k' ? xbox_udp::FILTER_KEY_COUNT : xbox_udp::FILTER_ABS_COUNT)) return 1;
+            xbox_udp::setStateBit(opt == 'k' ? filter.keys : filter.axes, static_cast<unsigned>(code), true);
+            filtered = true;
+            break;
+        }
+        case 'n':
+            kernel_filter = false;
+            break;
+        case 'j':
+            jitter_ms = std::stoul(optarg);
+            break;
+        case 'J':
+            jitter_max_ms = std::stoul(optarg);
+            break;
+        case 'p':
+            predict = true;
+            break;
+        case 'm':
+            shm_name = optarg;
+            break;
+        case 'P':
+            socket_profile = optarg;
+            break;
+        case 'O':
+            // Applied after --socket-profile, whatever the order
+            socket_flags.emplace_back(long_options[option_index].name, optarg);
+            break;
+        default:
+            std::cerr << "Usage: " << argv[0]
+                      << " [--group ADDR [--interface IF]] [--subscribe HOST[:PORT] [--rate HZ]"
+                      << " [--device N] [--key CODE] [--axis CODE]] [--no-kernel-filter]"
+                      << " [--jitter-ms MS [--jitter-max-ms MS]] [--state-from HOST[:PORT]] [--predict] [--shm NAME]"
+                      << " [--socket-profile FILE] [--busy-poll US] [--priority N] [--rcvbuf BYTES] [--rcvlowat BYTES]"
+                      << " [port | unix:/path]" << std::endl;
+            std::cerr << "  --subscribe  Register with the publisher at HOST (data port PORT, default "
+                      << xbox_udp::DEFAULT_PORT << ")" << std::endl;
+            std::cerr << "  --rate       Ask for coalesced state updates at most HZ times per second"
+                      << std::endl;
+            std::cerr << "  --device     Only controller N (repeatable)" << std::endl;
+            std::cerr << "  --key/--axis Only these EV_KEY/EV_ABS codes, e.g. --axis 2 --axis 5 for"
+                      << " the triggers (repeatable)" << std::endl;
+            std::cerr << "  --no-kernel-filter  Validate packets in userspace only (no BPF socket filter)"
+                      << std::endl;
+            std::cerr << "  --jitter-ms     Play input out MS after its timestamp (jitter buffer)" << std::endl;
+            std::cerr << "  --jitter-max-ms Adapt the jitter buffer delay between --jitter-ms and MS"
+                      << std::endl;
+            std::cerr << "  --state-from    Ask the publisher at HOST for the current controller state at"
+                      << " startup (default: the --subscribe publisher)" << std::endl;
+            std::cerr << "  --predict       Extrapolate moving sticks while reports are missing" << std::endl;
+            std::cerr << "  --shm           Read from joystick's shared-memory segment NAME instead of UDP"
+                      << std::endl;
+            std::cerr << "  --socket-profile  Socket options from the socket: section of a YAML file"
+                      << " (e.g. config/socket_profile.yaml); the flags below override it" << std::endl;
+            std::cerr << "  --busy-poll     SO_BUSY_POLL microseconds (poll() also needs the net.core.busy_poll"
+                      << " sysctl)" << std::endl;
+            std::cerr << "  --priority/--dscp/--sndbuf/--rcvbuf/--rcvlowat  SO_PRIORITY, IP_TOS DSCP (EF, AF41,"
+                      << " CS5 or 0-63) and buffer sizes in bytes (SO_RCVLOWAT: no effect on datagram sockets)" << std::endl;
+            std::cerr << "  unix:/path      Receive on a Unix datagram socket (joystick unix:/path) instead"
+                      << " of a UDP port" << std::endl;
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    std::string unix_endpoint;
+    if (optind < argc && socket_util::isUnixEndpoint(argv[optind])) {
+        unix_endpoint = argv[optind];
+    } else if (optind < argc) {
+        port = static_cast<unsigned short>(std::stoul(argv[optind]));
+    }
+    if (!shm_name.empty()) {
+        return run_shm(shm_name, predict);
+    }
+    socket_util::SocketOptions socket_options;
+    if (!socket_profile.empty() && !socket_util::loadSocketOptions(socket_profile, socket_options)) {
         return 1;
     }
+    for (const auto& flag : socket_flags) {
+        if (!socket_util::setSocketOption(socket_options, flag.first, flag.second)) return 1;
+    }
 
-    int opt = 1;
-    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "setsockopt SO_REUSEADDR: " << std::strerror(errno) << std::endl;
-        close(sock);
+    // Events only; the vibration port belongs to the publisher
+    UDPReceiver receiver(port, 0);
+    if (!unix_endpoint.empty()) {
+        receiver.setUnixSocket(unix_endpoint);
+    }
+    if (!group.empty()) {
+        receiver.setMulticastGroup(group, iface);
+    }
+    receiver.setKernelFilter(kernel_filter);
+    receiver.setLatencyStats(true);
+    receiver.setSocketOptions(socket_options);
+    if (jitter_ms > 0 || jitter_max_ms > 0) {
+        JitterBuffer::Config jitter;
+        jitter.delay_us = static_cast<uint32_t>(jitter_ms * 1000);
+        jitter.adaptive = jitter_max_ms > jitter_ms;
+        jitter.max_delay_us = static_cast<uint32_t>(jitter_max_ms * 1000);
+        receiver.setJitterBuffer(jitter);
+    }
+    if (!receiver.bind()) {
         return 1;
     }
+    if (!publisher.empty() &&
+        !receiver.subscribe(publisher, publisher_port + 1, static_cast<uint16_t>(rate_hz),
+                            filtered ? &filter : nullptr)) {
+        return 1;
+    }
+    if (state_host.empty() && !publisher.empty()) {
+        state_host = publisher;
+        state_port = publisher_port;
+    }
 
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port);
-
-    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        std::cerr << "bind :" << port << ": " << std::strerror(errno) << std::endl;
-        close(sock);
+    controller_states.setConfig(load_default_config());
+    if (predict) {
+        controller_states.setPrediction(AxisPredictor::Config());
+    }
+    receiver.setEventCallback([&receiver](const xbox_udp::InputEventPacket& pkt) {
+        controller_states.apply(pkt);
+        print_status(receiver);
+    });
+    // Apply a whole report before redrawing so stick X/Y move together
+    receiver.setFrameCallback([&receiver](const xbox_udp::FramePacket& frame) {
+        controller_states.apply(frame);
+        print_status(receiver);
+    });
+    // Keyframes and snapshots restore buttons pressed before we started listening
+    receiver.setStateCallback([&receiver](const xbox_udp::StatePacket& state) {
+        controller_states.apply(state);
+        print_status(receiver);
+    });
+    // Callbacks are in place: the snapshots may arrive with the next poll()
+    if (!state_host.empty() && !receiver.requestState(state_host, state_port + 1)) {
         return 1;
     }
 
-    std::cout << "UDP Receiver Test: listening on 0.0.0.0:" << port << std::endl;
-    std::cout << "In another terminal run: ./xbox_udp_publisher 127.0.0.1 " << port << std::endl;
+    if (unix_endpoint.empty()) {
+        std::cout << "UDP Receiver Test: listening on 0.0.0.0:" << port;
+    } else {
+        std::cout << "UDP Receiver Test: listening on " << unix_endpoint;
+    }
+    if (!group.empty()) std::cout << " (multicast group " << group << ")";
+    std::cout << std::endl;
+    std::cout << "Socket options: " << receiver.describeSocketOptions() << std::endl;
+    if (!publisher.empty()) {
+        std::cout << "Subscribed to " << publisher << ":" << publisher_port;
+        if (rate_hz) std::cout << " at " << rate_hz << " Hz";
+        if (filtered) std::cout << " (filtered)";
+        std::cout << std::endl;
+    }
+    if (unix_endpoint.empty()) {
+        std::cout << "In another terminal run: ./xbox_udp_publisher 127.0.0.1 " << port << std::endl;
+    } else {
+        std::cout << "In another terminal run: ./joystick " << unix_endpoint << std::endl;
+    }
     std::cout << "(Start the receiver first, then the publisher.)" << std::endl;
     std::cout << "Press Ctrl+C to exit." << std::endl << std::endl;
     
     // Initial display
-    print_status();
-
-    xbox_udp::InputEventPacket pkt;
-    struct pollfd pfd = { sock, POLLIN, 0 };
+    print_status(receiver);
 
     for (;;) {
-        int r = poll(&pfd, 1, 100);  // Shorter timeout for more responsive updates
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            std::cerr << "poll: " << std::strerror(errno) << std::endl;
-            break;
-        }
-        if (r == 0) {
-            // No data, but continue to allow periodic updates
-            continue;
-        }
-
-        ssize_t n = recv(sock, &pkt, sizeof(pkt), MSG_DONTWAIT);
-        if (n == static_cast<ssize_t>(sizeof(pkt))) {
-            if (pkt.magic != xbox_udp::PACKET_MAGIC) {
-                // Bad packet, ignore
-                continue;
-            }
-            update_state(pkt);
-            print_status();
-        } else if (n > 0) {
-            // Short read, ignore
-            continue;
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
-            std::cerr << "recv: " << std::strerror(errno) << std::endl;
+        if (predict) {
+            // Wake up every millisecond to extrapolate while reports are missing
+            receiver.poll(1);
+            if (controller_states.predict() > 0) print_status(receiver);
+        } else {
+            receiver.poll(100);  // Shorter timeout for more responsive updates
         }
     }
 
-    close(sock);
     return 0;
 }